@@ -0,0 +1,54 @@
+#!/usr/bin/python3
+"""
+Draw a moving rainbow from an asyncio task, paced by the display
+
+Run like this:
+
+$ python asyncio_rainbow.py
+
+Each frame is drawn while the previous one waits to be presented, and the task
+only awaits, so other tasks on the same event loop keep running. Press ctrl-c
+to exit.
+"""
+
+import asyncio
+
+import adafruit_blinka_raspberry_pi5_piomatter as piomatter
+import numpy as np
+
+width = 64
+height = 32
+
+
+async def rainbow(matrix, framebuffer):
+    x = np.arange(width)
+    phase = 0
+    while True:
+        hue = (x + phase) % width * (6 / width)
+        framebuffer[:, :, 0] = np.clip(np.abs(hue - 3) - 1, 0, 1)[None, :] * 255
+        framebuffer[:, :, 1] = np.clip(2 - np.abs(hue - 2), 0, 1)[None, :] * 255
+        framebuffer[:, :, 2] = np.clip(2 - np.abs(hue - 4), 0, 1)[None, :] * 255
+        await matrix.wait_buffer_available()
+        matrix.show()
+        await matrix.wait_presented()
+        phase += 1
+
+
+async def report(matrix):
+    while True:
+        await asyncio.sleep(1)
+        print(f"frame {matrix.last_presented[0]} [{matrix.fps:.1f}fps]")
+
+
+async def main():
+    geometry = piomatter.Geometry(width=width, height=height, n_addr_lines=4,
+                                  rotation=piomatter.Orientation.Normal)
+    framebuffer = np.zeros(shape=(height, width, 3), dtype=np.uint8)
+    matrix = piomatter.PioMatter(colorspace=piomatter.Colorspace.RGB888Packed,
+                                 pinout=piomatter.Pinout.AdafruitMatrixBonnet,
+                                 framebuffer=framebuffer,
+                                 geometry=geometry)
+    await asyncio.gather(rainbow(matrix, framebuffer), report(matrix))
+
+
+asyncio.run(main())
@@ -0,0 +1,38 @@
+#!/usr/bin/python3
+"""
+Show frames sent over the network with DDP, as used by xLights, WLED and
+many media servers
+
+Run like this:
+
+$ python ddp_receiver.py
+
+and point the sender at this machine's address, port 4048, with a 64x32 RGB
+layout. Receiving and displaying happens natively; Python only prints the
+receiver's counters every few seconds until interrupted with ctrl-c.
+"""
+
+import time
+
+import adafruit_blinka_raspberry_pi5_piomatter as piomatter
+import numpy as np
+
+width = 64
+height = 32
+
+geometry = piomatter.Geometry(width=width, height=height, n_addr_lines=4,
+                              rotation=piomatter.Orientation.Normal)
+framebuffer = np.zeros(shape=(height, width, 3), dtype=np.uint8)
+matrix = piomatter.PioMatter(colorspace=piomatter.Colorspace.RGB888Packed,
+                             pinout=piomatter.Pinout.AdafruitMatrixBonnet,
+                             framebuffer=framebuffer,
+                             geometry=geometry)
+
+matrix.receive_ddp()
+while True:
+    time.sleep(5)
+    stats = matrix.ddp_stats
+    print(f"{stats['frames']} frames, {stats['packets']} packets, "
+          f"{stats['packets_lost']} lost, {stats['packets_ignored']} ignored, "
+          f"latency {stats['last_latency_ns'] / 1e6:.2f}ms "
+          f"(max {stats['max_latency_ns'] / 1e6:.2f}ms)")
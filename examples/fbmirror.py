@@ -12,26 +12,21 @@ For help with commandline arguments, run `python fbmirror.py --help`
 """
 
 
+import signal
+
 import adafruit_blinka_raspberry_pi5_piomatter as piomatter
 import click
 import numpy as np
 import piomatter_click
 
-with open("/sys/class/graphics/fb0/virtual_size") as f:
-    screenx, screeny = [int(word) for word in f.read().split(",")]
-
 with open("/sys/class/graphics/fb0/bits_per_pixel") as f:
     bits_per_pixel = int(f.read())
 
-assert bits_per_pixel == 16
-
-bytes_per_pixel = bits_per_pixel // 8
-dtype = {2: np.uint16, 4: np.uint32}[bytes_per_pixel]
-
-with open("/sys/class/graphics/fb0/stride") as f:
-    stride = int(f.read())
-
-linux_framebuffer = np.memmap('/dev/fb0',mode='r', shape=(screeny, stride // bytes_per_pixel), dtype=dtype)
+# The framebuffer is read natively, so it has to match the colorspace
+colorspace, dtype = {
+    16: (piomatter.Colorspace.RGB565, np.uint16),
+    32: (piomatter.Colorspace.RGB888, np.uint32),
+}[bits_per_pixel]
 
 @click.command
 @click.option("--x-offset", "xoffset", type=int, help="The x offset of top left corner of the region to mirror",  default=0)
@@ -40,11 +35,10 @@ linux_framebuffer = np.memmap('/dev/fb0',mode='r', shape=(screeny, stride // byt
 def main(xoffset, yoffset, width, height, serpentine, rotation, pinout, n_planes, n_addr_lines):
     geometry = piomatter.Geometry(width=width, height=height, n_planes=n_planes, n_addr_lines=n_addr_lines, rotation=rotation)
     framebuffer = np.zeros(shape=(geometry.height, geometry.width), dtype=dtype)
-    matrix = piomatter.PioMatter(colorspace=piomatter.Colorspace.RGB565, pinout=pinout, framebuffer=framebuffer, geometry=geometry)
+    matrix = piomatter.PioMatter(colorspace=colorspace, pinout=pinout, framebuffer=framebuffer, geometry=geometry)
 
-    while True:
-        framebuffer[:,:] = linux_framebuffer[yoffset:yoffset+height, xoffset:xoffset+width]
-        matrix.show()
+    matrix.mirror_framebuffer("/dev/fb0", x_offset=xoffset, y_offset=yoffset)
+    signal.pause()
 
 if __name__ == '__main__':
     main()
@@ -37,27 +37,21 @@ or if `/boot/firmware/cmdline.txt` specifies a resolution such as
 `...  video=HDMI-A-1:640x480M@60D`.
 """
 
+import signal
+
 import adafruit_blinka_raspberry_pi5_piomatter as piomatter
 import click
 import numpy as np
-import PIL.Image as Image
 import piomatter_click
 
-with open("/sys/class/graphics/fb0/virtual_size") as f:
-    screenx, screeny = [int(word) for word in f.read().split(",")]
-
 with open("/sys/class/graphics/fb0/bits_per_pixel") as f:
     bits_per_pixel = int(f.read())
 
-assert bits_per_pixel == 16
-
-bytes_per_pixel = bits_per_pixel // 8
-dtype = {2: np.uint16, 4: np.uint32}[bytes_per_pixel]
-
-with open("/sys/class/graphics/fb0/stride") as f:
-    stride = int(f.read())
-
-linux_framebuffer = np.memmap('/dev/fb0',mode='r', shape=(screeny, stride // bytes_per_pixel), dtype=dtype)
+# The framebuffer is read natively, so it has to match the colorspace
+colorspace, dtype = {
+    16: (piomatter.Colorspace.RGB565, np.uint16),
+    32: (piomatter.Colorspace.RGB888, np.uint32),
+}[bits_per_pixel]
 
 
 @click.command
@@ -67,25 +61,12 @@ linux_framebuffer = np.memmap('/dev/fb0',mode='r', shape=(screeny, stride // byt
 @piomatter_click.standard_options
 def main(xoffset, yoffset, scale, width, height, serpentine, rotation, pinout, n_planes, n_addr_lines):
     geometry = piomatter.Geometry(width=width, height=height, n_planes=n_planes, n_addr_lines=n_addr_lines, rotation=rotation)
-    matrix_framebuffer = np.zeros(shape=(geometry.height, geometry.width, 3), dtype=np.uint8)
-    matrix = piomatter.PioMatter(colorspace=piomatter.Colorspace.RGB888Packed, pinout=pinout, framebuffer=matrix_framebuffer, geometry=geometry)
+    framebuffer = np.zeros(shape=(geometry.height, geometry.width), dtype=dtype)
+    matrix = piomatter.PioMatter(colorspace=colorspace, pinout=pinout, framebuffer=framebuffer, geometry=geometry)
 
-    while True:
-        tmp = linux_framebuffer[yoffset:yoffset + height * scale, xoffset:xoffset + width * scale]
-        # Convert the RGB565 framebuffer into RGB888Packed (so that we can use PIL image operations to rescale it)
-        r = (tmp & 0xf800) >> 8
-        r = r | (r >> 5)
-        r = r.astype(np.uint8)
-        g = (tmp & 0x07e0) >> 3
-        g = g | (g >> 6)
-        g = g.astype(np.uint8)
-        b = (tmp & 0x001f) << 3
-        b = b | (b >> 5)
-        b = b.astype(np.uint8)
-        img = Image.fromarray(np.stack([r, g, b], -1))
-        img = img.resize((width, height))
-        matrix_framebuffer[:, :] = np.array(img)
-        matrix.show()
+    # Each scale x scale block of the screen is averaged into one matrix pixel
+    matrix.mirror_framebuffer("/dev/fb0", x_offset=xoffset, y_offset=yoffset, scale=scale)
+    signal.pause()
 
 if __name__ == '__main__':
     main()
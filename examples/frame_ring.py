@@ -0,0 +1,61 @@
+#!/usr/bin/python3
+"""
+Feed the display from another process through shared memory
+
+Run the driver side in one terminal:
+
+$ python frame_ring.py serve
+
+and a producer in another, which doesn't need access to the matrix hardware:
+
+$ python frame_ring.py produce
+
+The producer draws a bouncing bar straight into shared memory, and the driver
+shows each frame without copying it or running any Python. Interrupt either
+with ctrl-c.
+"""
+
+import signal
+import sys
+import time
+
+import adafruit_blinka_raspberry_pi5_piomatter as piomatter
+import numpy as np
+
+width = 64
+height = 32
+ring_name = "/piomatter"
+
+
+def serve():
+    geometry = piomatter.Geometry(width=width, height=height, n_addr_lines=4,
+                                  rotation=piomatter.Orientation.Normal)
+    framebuffer = np.zeros(shape=(height, width, 3), dtype=np.uint8)
+    matrix = piomatter.PioMatter(colorspace=piomatter.Colorspace.RGB888Packed,
+                                 pinout=piomatter.Pinout.AdafruitMatrixBonnet,
+                                 framebuffer=framebuffer,
+                                 geometry=geometry)
+    matrix.serve_frame_ring(ring_name)
+    print(f"serving {ring_name}, ctrl-c to exit")
+    signal.pause()
+
+
+def produce():
+    ring = piomatter.FrameRingProducer(ring_name)
+    t0 = time.monotonic()
+    while True:
+        frame = ring.next_frame()
+        x = int((time.monotonic() - t0) * 40) % (2 * width - 8)
+        x = min(x, 2 * width - 8 - x)
+        frame[:] = 0
+        frame[:, x:x + 4] = (255, 128, 0)
+        ring.publish()
+        time.sleep(1 / 120)
+
+
+if sys.argv[1:] == ["serve"]:
+    serve()
+elif sys.argv[1:] == ["produce"]:
+    produce()
+else:
+    print(__doc__)
@@ -0,0 +1,51 @@
+#!/usr/bin/python3
+"""
+Draw on a display owned by the piomatterd daemon
+
+Start the daemon once, as root or a user with access to the PIO device, with
+options matching your panels:
+
+$ sudo src/piomatterd --width 64 --height 32 --socket /tmp/piomatterd.sock &
+
+then run clients like this one as often as you like:
+
+$ python piomatterd_client.py /tmp/piomatterd.sock
+
+The client asks the daemon for a frame ring and draws a color wash into it.
+When the client exits, the daemon keeps showing its last frame until the next
+client takes over, so the display never blanks.
+"""
+
+import socket
+import sys
+import time
+
+import adafruit_blinka_raspberry_pi5_piomatter as piomatter
+import numpy as np
+
+socket_path = sys.argv[1] if len(sys.argv) > 1 else "/run/piomatterd.sock"
+
+control = socket.socket(socket.AF_UNIX, socket.SOCK_SEQPACKET)
+control.connect(socket_path)
+_, version, width, height, pixel_size = control.recv(256).decode().split()
+width, height = int(width), int(height)
+if pixel_size != "3":
+    raise SystemExit("this example draws packed RGB888; start piomatterd with --colorspace rgb888packed")
+
+control.send(b"ring 3")
+status, ring_name = control.recv(256).decode().split(maxsplit=1)
+if status != "ok":
+    raise SystemExit(ring_name)
+ring = piomatter.FrameRingProducer(ring_name)
+
+x = np.arange(width)[None, :]
+y = np.arange(height)[:, None]
+t0 = time.monotonic()
+for _ in range(600):
+    t = time.monotonic() - t0
+    frame = ring.next_frame()
+    frame[:, :, 0] = (np.sin(x / 9 + t) * 127 + 128).astype(np.uint8)
+    frame[:, :, 1] = (np.sin(y / 5 + t * 1.3) * 127 + 128).astype(np.uint8)
+    frame[:, :, 2] = (np.sin((x + y) / 13 + t * 0.7) * 127 + 128).astype(np.uint8)
+    ring.publish()
+    time.sleep(1 / 60)
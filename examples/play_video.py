@@ -0,0 +1,45 @@
+#!/usr/bin/python3
+"""
+Play a video file by piping it from ffmpeg straight into the display
+
+Run like this:
+
+$ python play_video.py clip.mp4
+
+ffmpeg decodes and scales the video to the size of the display and writes it
+as YUV4MPEG2 to a pipe. Reading, pacing and converting the frames happens
+natively; Python only waits for the video to end.
+"""
+
+import subprocess
+import sys
+
+import adafruit_blinka_raspberry_pi5_piomatter as piomatter
+import numpy as np
+
+width = 64
+height = 32
+
+geometry = piomatter.Geometry(width=width, height=height, n_addr_lines=4,
+                              rotation=piomatter.Orientation.Normal)
+framebuffer = np.zeros(shape=(height, width, 3), dtype=np.uint8)
+matrix = piomatter.PioMatter(colorspace=piomatter.Colorspace.RGB888Packed,
+                             pinout=piomatter.Pinout.AdafruitMatrixBonnet,
+                             framebuffer=framebuffer,
+                             geometry=geometry)
+
+ffmpeg = subprocess.Popen(
+    ["ffmpeg", "-loglevel", "error", "-i", sys.argv[1],
+     "-vf", f"scale={width}:{height}", "-pix_fmt", "yuv420p",
+     "-f", "yuv4mpegpipe", "-"],
+    stdout=subprocess.PIPE)
+matrix.play_video(ffmpeg.stdout.fileno(), piomatter.VideoFormat.Y4M,
+                  drop_late=True)
+try:
+    matrix.wait_video()
+finally:
+    matrix.stop_video()
+    ffmpeg.kill()
+    stats = matrix.video_stats
+    print(f"{stats['frames']} frames, {stats['frames_late']} late, "
+          f"{stats['frames_dropped']} dropped")
@@ -1,38 +1,35 @@
 #!/usr/bin/python3
 """
-Display a series of 64x32 PNG images as fast as possible
+Display a series of 64x32 PNG images as an animation
 
 Run like this:
 
-$ python playframes.py "/path/to/images/*.png"
+$ python playframes.py "/path/to/images/*.png" [frames per second]
 
-The image files are sorted and then played repeatedly until interrupted with ctrl-c.
+The image files are sorted, loaded once and then played repeatedly at 30
+frames per second, or the given rate, until interrupted with ctrl-c. Playback
+happens entirely in the blitter thread, so Python is idle meanwhile.
 """
 
 import glob
+import signal
 import sys
-import time
 
 import adafruit_blinka_raspberry_pi5_piomatter as piomatter
 import numpy as np
 import PIL.Image as Image
 
 images = sorted(glob.glob(sys.argv[1]))
+rate = float(sys.argv[2]) if len(sys.argv) > 2 else 30
 
 geometry = piomatter.Geometry(width=64, height=32, n_addr_lines=4, rotation=piomatter.Orientation.Normal)
-framebuffer = np.asarray(Image.open(images[0])) + 0  # Make a mutable copy
-nimages = len(images)
+frames = [np.asarray(Image.open(i).convert("RGB")) for i in images]
+framebuffer = frames[0] + 0  # Make a mutable copy
 matrix = piomatter.PioMatter(colorspace=piomatter.Colorspace.RGB888Packed,
                              pinout=piomatter.Pinout.AdafruitMatrixBonnet,
                              framebuffer=framebuffer,
                              geometry=geometry)
 
-while True:
-    t0 = time.monotonic()
-    for i in images:
-        framebuffer[:] = np.asarray(Image.open(i))
-        matrix.show()
-    t1 = time.monotonic()
-    dt = t1 - t0
-    fps = nimages/dt
-    print(f"{nimages} frames in {dt}s, {fps}fps [{matrix.fps}]")
+matrix.play(frames, durations=1 / rate)
+print(f"{len(frames)} frames at {rate}fps [{matrix.fps}]")
+signal.pause()
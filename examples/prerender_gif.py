@@ -0,0 +1,51 @@
+#!/usr/bin/python3
+"""
+Render an animated gif to a stream file once, then play it from the file
+
+Run like this:
+
+$ python prerender_gif.py [nyan.gif]
+
+The first run renders the gif to a .pms file next to it, which takes a moment
+but needs no matrix hardware. Later runs map the file and start playing at
+once, with the CPU idle, until interrupted with ctrl-c.
+"""
+
+import os
+import signal
+import sys
+
+import adafruit_blinka_raspberry_pi5_piomatter as piomatter
+import numpy as np
+import PIL.Image as Image
+
+width = 64
+height = 32
+
+gif_file = sys.argv[1] if len(sys.argv) > 1 else "nyan.gif"
+stream_file = os.path.splitext(gif_file)[0] + ".pms"
+
+colorspace = piomatter.Colorspace.RGB888Packed
+pinout = piomatter.Pinout.AdafruitMatrixBonnet
+geometry = piomatter.Geometry(width=width, height=height,
+                              n_addr_lines=4, rotation=piomatter.Orientation.Normal)
+
+if not os.path.exists(stream_file):
+    frames = []
+    durations = []
+    with Image.open(gif_file) as img:
+        for i in range(img.n_frames):
+            img.seek(i)
+            canvas = Image.new('RGB', (width, height), (0, 0, 0))
+            canvas.paste(img.convert('RGB'), (0, 0))
+            frames.append(np.asarray(canvas))
+            durations.append(img.info.get('duration', 100) / 1000)
+    piomatter.render_stream_file(stream_file, colorspace, pinout, geometry,
+                                 frames, durations)
+    print(f"rendered {len(frames)} frames to {stream_file}")
+
+framebuffer = np.zeros(shape=(height, width, 3), dtype=np.uint8)
+matrix = piomatter.PioMatter(colorspace=colorspace, pinout=pinout,
+                             framebuffer=framebuffer, geometry=geometry)
+matrix.play_file(stream_file)
+signal.pause()
@@ -14,6 +14,8 @@ $ python quote_scroller.py
 
 """
 
+import signal
+
 import adafruit_blinka_raspberry_pi5_piomatter as piomatter
 import numpy as np
 import requests
@@ -25,6 +27,9 @@ total_height = 32
 
 bottom_half_shift_compensation = 1
 
+# pixels per second
+scroll_speed = 60
+
 font_color = (0, 128, 128)
 
 # Load the font
@@ -42,29 +47,27 @@ draw = ImageDraw.Draw(full_txt_img)
 draw.text((3, 3), text, font=font, fill=font_color)
 full_txt_img.save("quote.png")
 
-single_frame_img = Image.new("RGB", (total_width, total_height), (0, 0, 0))
+# The whole quote goes on a canvas with a blank display's width on either side,
+# so that it scrolls in from the right and out to the left before repeating.
+canvas_img = Image.new("RGB", (full_txt_img.width + 2 * total_width, total_height), (0, 0, 0))
+# top half
+canvas_img.paste(full_txt_img.crop((0, 0, full_txt_img.width, total_height//2)), (total_width, 0))
+# bottom half shift compensation
+canvas_img.paste(full_txt_img.crop((0, total_height//2, full_txt_img.width, total_height)),
+                 (total_width + bottom_half_shift_compensation, total_height//2))
 
 geometry = piomatter.Geometry(width=total_width, height=total_height,
                               n_addr_lines=4, rotation=piomatter.Orientation.Normal)
-framebuffer = np.asarray(single_frame_img) + 0  # Make a mutable copy
+framebuffer = np.zeros(shape=(total_height, total_width, 3), dtype=np.uint8)
 
 matrix = piomatter.PioMatter(colorspace=piomatter.Colorspace.RGB888Packed,
                              pinout=piomatter.Pinout.AdafruitMatrixBonnet,
                              framebuffer=framebuffer,
                              geometry=geometry)
 
+# The canvas is converted once; scrolling then runs natively, without Python
+matrix.set_canvas(np.asarray(canvas_img))
+matrix.scroll(dx=scroll_speed)
+
 print("Ctrl-C to exit")
-while True:
-    for x_pixel in range(-total_width-1,full_txt_img.width):
-        if bottom_half_shift_compensation == 0:
-            # full paste
-            single_frame_img.paste(full_txt_img.crop((x_pixel, 0, x_pixel + total_width, total_height)), (0, 0))
-
-        else:
-            # top half
-            single_frame_img.paste(full_txt_img.crop((x_pixel, 0, x_pixel + total_width, total_height//2)), (0, 0))
-            # bottom half shift compensation
-            single_frame_img.paste(full_txt_img.crop((x_pixel, total_height//2, x_pixel + total_width, total_height)), (bottom_half_shift_compensation, total_height//2))
-
-        framebuffer[:] = np.asarray(single_frame_img)
-        matrix.show()
+signal.pause()
@@ -57,8 +57,12 @@ def main(scale, backend, use_xauth, extra_args, rfbport, width, height, serpenti
                 img = disp.grab(autocrop=False)
                 if img is None:
                     continue
-                img = img.resize((width, height))
-                framebuffer[:, :] = np.array(img)
-                matrix.show()
+                if scale == int(scale):
+                    # averaged down while converting, without a copy
+                    matrix.show(np.asarray(img))
+                else:
+                    img = img.resize((width, height))
+                    framebuffer[:, :] = np.array(img)
+                    matrix.show()
 if __name__ == '__main__':
     main()
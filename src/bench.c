@@ -0,0 +1,192 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <random>
+#include <vector>
+
+#include "piomatter/pins.h"
+#include "piomatter/render.h"
+
+// Time conversion and rendering on the host; no PIO hardware is needed.
+
+static uint64_t monotonicns64() {
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return tp.tv_sec * UINT64_C(1000000000) + tp.tv_nsec;
+}
+
+template <typename F> double time_per_call(int n, F f) {
+    f();
+    uint64_t start = monotonicns64();
+    for (int i = 0; i < n; i++) {
+        f();
+    }
+    return (monotonicns64() - start) / 1e3 / n;
+}
+
+template <typename T> std::vector<T> random_pixels(size_t n) {
+    std::mt19937 rng(1);
+    std::vector<T> result(n);
+    for (auto &p : result) {
+        p = rng();
+    }
+    return result;
+}
+
+void bench_convert(size_t width, size_t height, int n) {
+    const size_t n_pixels = width * height;
+    piomatter::gamma_lut lut;
+    std::vector<uint32_t> reference;
+
+    auto rgb565 = random_pixels<uint16_t>(n_pixels);
+    piomatter::colorspace_rgb565 cs565;
+    double old565 = time_per_call(
+        n, [&] { lut.convert_rgb565_to_rgb10(reference, rgb565); });
+    double new565 = time_per_call(n, [&] { cs565.convert(rgb565); });
+    if (!std::ranges::equal(reference, cs565.convert(rgb565))) {
+        printf("rgb565 mismatch\n");
+        exit(1);
+    }
+
+    auto rgb888 = random_pixels<uint32_t>(n_pixels);
+    piomatter::colorspace_rgb888 cs888;
+    double old888 = time_per_call(
+        n, [&] { lut.convert_rgb888_to_rgb10(reference, rgb888); });
+    double new888 = time_per_call(n, [&] { cs888.convert(rgb888); });
+    if (!std::ranges::equal(reference, cs888.convert(rgb888))) {
+        printf("rgb888 mismatch\n");
+        exit(1);
+    }
+
+    auto packed = random_pixels<uint8_t>(n_pixels * 3);
+    piomatter::colorspace_rgb888_packed cspacked;
+    double oldpacked = time_per_call(
+        n, [&] { lut.convert_rgb888_packed_to_rgb10(reference, packed); });
+    double newpacked = time_per_call(n, [&] { cspacked.convert(packed); });
+    if (!std::ranges::equal(reference, cspacked.convert(packed))) {
+        printf("rgb888 packed mismatch\n");
+        exit(1);
+    }
+
+    printf("convert %4zux%-4zu  gamma_lut/direct us: rgb565 %8.1f %8.1f  "
+           "rgb888 %8.1f %8.1f  packed %8.1f %8.1f\n",
+           width, height, old565, new565, old888, new888, oldpacked,
+           newpacked);
+}
+
+// Convert the middle of a canvas twice as wide, as a strided view, and
+// compare with converting a contiguous copy of the same region
+void bench_strided(size_t width, size_t height, int n) {
+    auto canvas = random_pixels<uint32_t>(2 * width * height);
+    std::vector<uint32_t> region;
+    for (size_t y = 0; y < height; y++) {
+        auto row = canvas.begin() + 2 * width * y + width / 2;
+        region.insert(region.end(), row, row + width);
+    }
+    piomatter::framebuffer_view<uint32_t> view{
+        canvas.data() + width / 2, width, height,
+        ptrdiff_t(2 * width * sizeof(uint32_t)), sizeof(uint32_t)};
+
+    piomatter::colorspace_rgb888 contiguous, strided;
+    double t_contiguous = time_per_call(n, [&] { contiguous.convert(region); });
+    double t_strided = time_per_call(n, [&] { strided.convert(view); });
+    if (!std::ranges::equal(contiguous.convert(region),
+                            strided.convert(view))) {
+        printf("strided rgb888 mismatch\n");
+        exit(1);
+    }
+    printf("strided %4zux%-4zu  contiguous/strided us: rgb888 %8.1f %8.1f\n",
+           width, height, t_contiguous, t_strided);
+}
+
+// Average a source `scale` times the geometry size down while converting,
+// and compare with averaging gamma_lut results
+void bench_downscale(size_t width, size_t height, size_t n_addr_lines,
+                     size_t scale, int n) {
+    size_t pixels_across = width * height / (2 << n_addr_lines);
+    piomatter::matrix_geometry geometry(pixels_across, n_addr_lines, 10, width,
+                                        height, true,
+                                        piomatter::orientation_normal);
+    size_t source_width = width * scale, source_height = height * scale;
+    auto source = random_pixels<uint32_t>(source_width * source_height);
+    piomatter::framebuffer_view<uint32_t> view{
+        std::span<const uint32_t>(source), source_width};
+
+    piomatter::gamma_lut lut;
+    std::vector<uint32_t> full, reference(width * height);
+    lut.convert_rgb888_to_rgb10(full, source);
+    uint32_t count = scale * scale;
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            uint32_t r = 0, g = 0, b = 0;
+            for (size_t sy = 0; sy < scale; sy++) {
+                for (size_t sx = 0; sx < scale; sx++) {
+                    uint32_t v = full[(y * scale + sy) * source_width +
+                                      x * scale + sx];
+                    r += v >> 20;
+                    g += (v >> 10) & 0x3ff;
+                    b += v & 0x3ff;
+                }
+            }
+            reference[y * width + x] = ((r + count / 2) / count << 20) |
+                                       ((g + count / 2) / count << 10) |
+                                       ((b + count / 2) / count);
+        }
+    }
+
+    piomatter::colorspace_rgb888 cs888(geometry);
+    double t = time_per_call(n, [&] { cs888.convert(view); });
+    if (!std::ranges::equal(reference, cs888.convert(view))) {
+        printf("downscaled rgb888 mismatch\n");
+        exit(1);
+    }
+    printf("scale   %4zux%-4zu  from %zux%zu us: rgb888 %8.1f\n", width,
+           height, source_width, source_height, t);
+}
+
+template <typename Cb>
+void bench_render(const char *name, size_t width, size_t height,
+                  size_t n_addr_lines, const Cb &cb, int n) {
+    size_t pixels_across = width * height / (2 << n_addr_lines);
+    piomatter::matrix_geometry geometry(pixels_across, n_addr_lines, 10, width,
+                                        height, true, cb);
+    auto pixels = random_pixels<uint32_t>(width * height);
+    std::vector<uint32_t> stream;
+    double t = time_per_call(n, [&] {
+        piomatter::protomatter_render_rgb10<
+            piomatter::adafruit_matrix_bonnet_pinout>(stream, geometry,
+                                                      pixels.data());
+    });
+    printf("render  %4zux%-4zu %-6s %8.1f us\n", width, height, name, t);
+}
+
+void bench_render(size_t width, size_t height, size_t n_addr_lines, int n) {
+    bench_render("normal", width, height, n_addr_lines,
+                 piomatter::orientation_normal, n);
+    bench_render("r180", width, height, n_addr_lines,
+                 piomatter::orientation_r180, n);
+    bench_render("cw", width, height, n_addr_lines, piomatter::orientation_cw,
+                 n);
+    bench_render("ccw", width, height, n_addr_lines,
+                 piomatter::orientation_ccw, n);
+}
+
+int main(int argc, char **argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 100;
+
+    bench_convert(64, 32, n);
+    bench_convert(64, 64, n);
+    bench_convert(256, 128, n);
+    bench_convert(640, 480, n / 10 + 1);
+
+    bench_strided(64, 64, n);
+    bench_strided(640, 480, n / 10 + 1);
+
+    bench_downscale(64, 32, 4, 2, n);
+    bench_downscale(128, 64, 5, 5, n / 10 + 1);
+
+    bench_render(64, 32, 4, n);
+    bench_render(64, 64, 5, n);
+    bench_render(256, 128, 5, n / 10 + 1);
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "thread_queue.h"
+#include <atomic>
 
 namespace piomatter {
 
@@ -13,6 +14,8 @@ struct buffer_manager {
     }
 
     int get_free_buffer() { return free_buffers.pop_blocking(); }
+    // whether get_free_buffer() would return without waiting, for now
+    bool has_free_buffer() { return !free_buffers.empty(); }
     void put_free_buffer(int i) { free_buffers.push(i); }
 
     int get_filled_buffer() {
@@ -22,9 +25,16 @@ struct buffer_manager {
 
     void put_filled_buffer(int i) { filled_buffers.push(i); }
 
-    void request_exit() { filled_buffers.push(exit_request); }
+    void request_exit() {
+        exiting = true;
+        filled_buffers.push(exit_request);
+    }
+
+    // for a consumer that may stop popping filled buffers for a while
+    bool exit_requested() const { return exiting; }
 
   private:
+    std::atomic<bool> exiting{false};
     thread_queue<int> free_buffers, filled_buffers;
 };
 
@@ -0,0 +1,181 @@
+#pragma once
+
+#include "piomatter.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace piomatter {
+
+constexpr uint16_t ddp_default_port = 4048;
+
+// DDP (Distributed Display Protocol) header fields
+constexpr uint8_t ddp_flag_version_mask = 0xc0;
+constexpr uint8_t ddp_flag_version_1 = 0x40;
+constexpr uint8_t ddp_flag_timecode = 0x10;
+constexpr uint8_t ddp_flag_query = 0x02;
+constexpr uint8_t ddp_flag_push = 0x01;
+constexpr uint8_t ddp_sequence_mask = 0x0f;
+constexpr size_t ddp_header_size = 10;
+constexpr size_t ddp_timecode_size = 4;
+// the display device, and the "all devices" id some senders use instead
+constexpr uint8_t ddp_id_display = 1;
+constexpr uint8_t ddp_id_all = 255;
+
+// Receive frames of packed RGB888 pixels over UDP with DDP, from a thread of
+// its own. Each packet's data goes to its byte offset in the frame, and a
+// packet with the push flag shows the frame as it is. Packets that are
+// malformed, not pixel data or outside the frame are counted and ignored.
+struct ddp_receiver {
+    ddp_receiver(piomatter_base &matter, size_t width, size_t height,
+                 const std::string &address, uint16_t port)
+        : matter{matter}, width{width}, frame(width * height * 3) {
+        fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            throw_errno("socket");
+        }
+        // room for a few frames' worth of packets while one is rendered
+        int rcvbuf = std::max<int>(frame.size() * 4, 1 << 20);
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+        sockaddr_in sa{};
+        sa.sin_family = AF_INET;
+        sa.sin_port = htons(port);
+        if (inet_pton(AF_INET, address.empty() ? "0.0.0.0" : address.c_str(),
+                      &sa.sin_addr) != 1) {
+            close(fd);
+            throw std::runtime_error("invalid address " + address);
+        }
+        if (bind(fd, reinterpret_cast<sockaddr *>(&sa), sizeof(sa)) < 0) {
+            int saved_errno = errno;
+            close(fd);
+            errno = saved_errno;
+            throw_errno("bind port " + std::to_string(port));
+        }
+        receive_thread = std::thread{&ddp_receiver::receive, this};
+    }
+
+    ddp_receiver(const ddp_receiver &) = delete;
+    ddp_receiver &operator=(const ddp_receiver &) = delete;
+
+    ~ddp_receiver() {
+        exit_request = true;
+        receive_thread.join();
+        close(fd);
+    }
+
+    // packets accepted, packets ignored, packets missing from the sequence
+    // numbers, and frames shown
+    std::atomic<uint64_t> packets{0}, packets_ignored{0}, packets_lost{0},
+        frames{0};
+    // from the first packet of a frame to when it has been rendered, in ns
+    std::atomic<uint64_t> last_latency{0}, max_latency{0};
+
+  private:
+    [[noreturn]] static void throw_errno(const std::string &what) {
+        throw std::runtime_error(what + ": " + strerror(errno));
+    }
+
+    static uint32_t get_be32(const uint8_t *p) {
+        return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 |
+               uint32_t(p[2]) << 8 | p[3];
+    }
+
+    // Count the packets skipped between two sequence numbers, which run
+    // from 1 to 15; 0 means the sender doesn't number its packets
+    void check_sequence(uint8_t sequence) {
+        if (sequence && last_sequence) {
+            packets_lost += (sequence + 14 - last_sequence) % 15;
+        }
+        last_sequence = sequence;
+    }
+
+    // Returns false if the packet is to be ignored
+    bool handle_packet(const uint8_t *packet, size_t size, uint64_t now) {
+        if (size < ddp_header_size) {
+            return false;
+        }
+        uint8_t flags = packet[0];
+        uint8_t data_type = packet[2];
+        uint8_t id = packet[3];
+        size_t header_size = ddp_header_size;
+        if (flags & ddp_flag_timecode) {
+            header_size += ddp_timecode_size;
+        }
+        // only RGB with 8 bits per channel, which some senders leave as 0
+        // (undefined) or give the older value 1
+        bool rgb888 = data_type == 0x0b || data_type == 0x01 || !data_type;
+        if ((flags & ddp_flag_version_mask) != ddp_flag_version_1 ||
+            (flags & ddp_flag_query) || !rgb888 ||
+            (id != ddp_id_display && id != ddp_id_all) || size < header_size) {
+            return false;
+        }
+        size_t offset = get_be32(packet + 4);
+        size_t length = size_t(packet[8]) << 8 | packet[9];
+        if (length > size - header_size || offset > frame.size() ||
+            length > frame.size() - offset) {
+            return false;
+        }
+
+        check_sequence(packet[1] & ddp_sequence_mask);
+        if (!frame_start) {
+            frame_start = now;
+        }
+        memcpy(frame.data() + offset, packet + header_size, length);
+        if (flags & ddp_flag_push) {
+            matter.show_rgb888({frame, width, 3});
+            uint64_t latency = monotonicns64() - frame_start;
+            last_latency = latency;
+            if (latency > max_latency) {
+                max_latency = latency;
+            }
+            frame_start = 0;
+            frames++;
+        }
+        return true;
+    }
+
+    void receive() {
+        std::vector<uint8_t> packet(65536);
+        while (!exit_request) {
+            pollfd pfd{fd, POLLIN, 0};
+            // wake up now and then to check for exit requests
+            if (poll(&pfd, 1, 100) <= 0) {
+                continue;
+            }
+            ssize_t n = recv(fd, packet.data(), packet.size(), MSG_DONTWAIT);
+            if (n < 0) {
+                continue;
+            }
+            try {
+                if (handle_packet(packet.data(), n, monotonicns64())) {
+                    packets++;
+                } else {
+                    packets_ignored++;
+                }
+            } catch (const std::exception &) {
+                packets_ignored++;
+            }
+        }
+    }
+
+    piomatter_base &matter;
+    size_t width;
+    // the frame being received, in packed RGB888
+    std::vector<uint8_t> frame;
+    int fd = -1;
+    uint8_t last_sequence = 0;
+    uint64_t frame_start = 0;
+    std::atomic<bool> exit_request{false};
+    std::thread receive_thread;
+};
+
+} // namespace piomatter
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "piomatter.h"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/fb.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace piomatter {
+
+// Mirror a region of a Linux framebuffer device to the matrix, from a thread
+// of its own. The region is `scale` times the matrix size, and the converter
+// averages it down. Its rows are compared with a copy of those shown last,
+// and nothing is converted or rendered while they are unchanged.
+struct fbdev_mirror {
+    fbdev_mirror(piomatter_base &matter, const std::string &device, size_t x,
+                 size_t y, size_t width, size_t height, size_t pixel_size,
+                 size_t scale, double rate)
+        : matter{matter}, width{width}, height{height}, scale{scale} {
+        if (scale < 1 || !(rate > 0)) {
+            throw std::range_error("scale and rate must be positive");
+        }
+        try {
+            open_device(device, pixel_size);
+            if (x + width * scale > var.xres || y + height * scale > var.yres) {
+                throw std::range_error(
+                    "mirrored region extends outside the framebuffer");
+            }
+            // the visible area is panned within the memory, which the
+            // driver need not make large enough for it
+            size_t end =
+                (var.yoffset + y + height * scale - 1) * line_length +
+                (var.xoffset + x + width * scale) * pixel_size;
+            if (end > mapped_size) {
+                throw std::range_error("mirrored region extends outside the "
+                                       "framebuffer memory");
+            }
+        } catch (...) {
+            release();
+            throw;
+        }
+
+        region = mapped + var.yoffset * line_length +
+                 var.xoffset * pixel_size + y * line_length + x * pixel_size;
+        this->pixel_size = pixel_size;
+        row_bytes = width * scale * pixel_size;
+        shadow.resize(height * scale * row_bytes);
+
+        auto period = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::duration<double>(1 / rate));
+        mirror_thread = std::thread{&fbdev_mirror::mirror, this, period};
+    }
+
+    fbdev_mirror(const fbdev_mirror &) = delete;
+    fbdev_mirror &operator=(const fbdev_mirror &) = delete;
+
+    ~fbdev_mirror() {
+        exit_request = true;
+        mirror_thread.join();
+        release();
+    }
+
+    // frames shown, and frames skipped because nothing changed
+    std::atomic<uint64_t> frames_shown{0}, frames_unchanged{0};
+
+  private:
+    void open_device(const std::string &device, size_t pixel_size) {
+        fd = open(device.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw_errno("open " + device);
+        }
+        fb_fix_screeninfo fix;
+        if (ioctl(fd, FBIOGET_VSCREENINFO, &var) < 0 ||
+            ioctl(fd, FBIOGET_FSCREENINFO, &fix) < 0) {
+            throw_errno("query " + device);
+        }
+
+        // RGB565, or XRGB8888 which has the same layout as rgb888 pixels
+        bool rgb565 = var.bits_per_pixel == 16 && var.red.offset == 11 &&
+                      var.green.offset == 5 && var.blue.offset == 0;
+        bool xrgb8888 = var.bits_per_pixel == 32 && var.red.offset == 16 &&
+                        var.green.offset == 8 && var.blue.offset == 0;
+        if (!(rgb565 || xrgb8888) || var.bits_per_pixel != pixel_size * 8) {
+            throw std::runtime_error(
+                device + " has " + std::to_string(var.bits_per_pixel) +
+                " bits per pixel, which does not match the colorspace");
+        }
+
+        line_length = fix.line_length;
+        mapped_size = fix.smem_len;
+        void *p = mmap(nullptr, mapped_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            throw_errno("mmap " + device);
+        }
+        mapped = static_cast<const uint8_t *>(p);
+    }
+
+    [[noreturn]] static void throw_errno(const std::string &what) {
+        throw std::runtime_error(what + ": " + strerror(errno));
+    }
+
+    void release() {
+        if (mapped) {
+            munmap(const_cast<uint8_t *>(mapped), mapped_size);
+            mapped = nullptr;
+        }
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    // Copy the rows that changed; true if any did
+    bool update_shadow() {
+        bool changed = false;
+        for (size_t i = 0; i < height * scale; i++) {
+            const uint8_t *src = region + i * line_length;
+            uint8_t *dst = shadow.data() + i * row_bytes;
+            if (memcmp(src, dst, row_bytes)) {
+                memcpy(dst, src, row_bytes);
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    void mirror(std::chrono::nanoseconds period) {
+        framebuffer_view<uint8_t> view{shadow.data(), width * scale,
+                                       height * scale, ptrdiff_t(row_bytes),
+                                       ptrdiff_t(pixel_size)};
+        bool first = true;
+        auto next = std::chrono::steady_clock::now();
+        while (!exit_request) {
+            if (update_shadow() || first) {
+                matter.show(view);
+                frames_shown++;
+                first = false;
+            } else {
+                frames_unchanged++;
+            }
+            // don't try to catch up after falling behind
+            next = std::max(next + period, std::chrono::steady_clock::now());
+            std::this_thread::sleep_until(next);
+        }
+    }
+
+    piomatter_base &matter;
+    size_t width, height, scale;
+    int fd = -1;
+    fb_var_screeninfo var;
+    const uint8_t *mapped = nullptr;
+    size_t mapped_size = 0, line_length = 0;
+    const uint8_t *region = nullptr;
+    size_t pixel_size = 0, row_bytes = 0;
+    std::vector<uint8_t> shadow;
+    std::atomic<bool> exit_request{false};
+    std::thread mirror_thread;
+};
+
+} // namespace piomatter
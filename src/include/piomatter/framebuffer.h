@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace piomatter {
+
+// A width x height region of pixels whose rows start `row_pitch` bytes apart
+// and whose pixels are `pixel_pitch` bytes apart, such as a slice of a larger
+// canvas. `data` points at the first element of the top left pixel.
+template <typename T> struct framebuffer_view {
+    framebuffer_view() = default;
+    framebuffer_view(const T *data, size_t width, size_t height,
+                     ptrdiff_t row_pitch, ptrdiff_t pixel_pitch)
+        : data{data}, width{width}, height{height}, row_pitch{row_pitch},
+          pixel_pitch{pixel_pitch} {}
+
+    // Contiguous pixels of `pixel_size` bytes, in rows of `width` pixels; a
+    // width of 0 makes them a single row
+    framebuffer_view(std::span<const T> pixels, size_t width,
+                     size_t pixel_size = sizeof(T))
+        : data{pixels.data()} {
+        size_t n = pixels.size_bytes() / pixel_size;
+        this->width = width ? width : n;
+        height = this->width ? n / this->width : 0;
+        pixel_pitch = pixel_size;
+        row_pitch = this->width * pixel_size;
+    }
+
+    size_t size() const { return width * height; }
+
+    bool contiguous(size_t pixel_size = sizeof(T)) const {
+        return size_t(pixel_pitch) == pixel_size &&
+               (height <= 1 || size_t(row_pitch) == width * pixel_size);
+    }
+
+    const T *row(size_t y) const {
+        auto base = reinterpret_cast<const uint8_t *>(data);
+        return reinterpret_cast<const T *>(base + ptrdiff_t(y) * row_pitch);
+    }
+
+    const T *next(const T *pixel) const {
+        auto base = reinterpret_cast<const uint8_t *>(pixel);
+        return reinterpret_cast<const T *>(base + pixel_pitch);
+    }
+
+    // The same pixels, viewed as elements of another type
+    template <typename U> framebuffer_view<U> as() const {
+        return {reinterpret_cast<const U *>(data), width, height, row_pitch,
+                pixel_pitch};
+    }
+
+    const T *data = nullptr;
+    size_t width = 0, height = 0;
+    ptrdiff_t row_pitch = 0, pixel_pitch = 0;
+};
+
+} // namespace piomatter
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 
 namespace piomatter {
@@ -9,6 +12,10 @@ using matrix_map = std::vector<int>;
 
 enum orientation { normal, r180, ccw, cw };
 
+enum scan_order { linear, interlaced, bit_reversed };
+
+enum dither_mode { no_dither, bayer, blue_noise };
+
 int orientation_normal(int width, int height, int x, int y) {
     return x + width * y;
 }
@@ -24,7 +31,7 @@ int orientation_ccw(int width, int height, int x, int y) {
 }
 
 int orientation_cw(int width, int height, int x, int y) {
-    return orientation_normal(height, width, y - height - 1, x);
+    return orientation_normal(height, width, height - y - 1, x);
 }
 
 namespace {
@@ -80,23 +87,373 @@ matrix_map make_matrixmap(size_t width, size_t height, size_t n_addr_lines,
     return result;
 }
 
+// Where one panel of a chain is mounted: the top left corner of the area it
+// covers on the canvas, its width in pixels (before rotation), and how it is
+// rotated. The panel height follows from the number of address lines.
+struct panel_placement {
+    int x, y;
+    size_t width;
+    orientation rotation;
+};
+
+// Build the map for panels listed in chain order, in the same sense as
+// make_matrixmap: the first panel is the one that is at the top when panels
+// are stacked vertically.
+matrix_map make_layout_matrixmap(size_t width, size_t height,
+                                 size_t n_addr_lines,
+                                 const std::vector<panel_placement> &panels) {
+    if (panels.empty()) {
+        throw std::range_error("layout must have at least one panel");
+    }
+    int panel_height = 2 << n_addr_lines;
+    size_t half_panel_height = 1u << n_addr_lines;
+    size_t pixels_across = 0;
+    for (const auto &panel : panels) {
+        pixels_across += panel.width;
+    }
+
+    // canvas index of pixel (px, py) of a panel
+    auto canvas_index = [&](const panel_placement &panel, int px, int py) {
+        int panel_width = panel.width;
+        int x, y;
+        switch (panel.rotation) {
+        case normal:
+            x = px;
+            y = py;
+            break;
+        case r180:
+            x = panel_width - px - 1;
+            y = panel_height - py - 1;
+            break;
+        case cw:
+            x = panel_height - py - 1;
+            y = px;
+            break;
+        case ccw:
+            x = py;
+            y = panel_width - px - 1;
+            break;
+        default:
+            throw std::range_error("invalid panel rotation");
+        }
+        x += panel.x;
+        y += panel.y;
+        if (x < 0 || y < 0 || x >= int(width) || y >= int(height)) {
+            throw std::range_error("panel extends outside the canvas");
+        }
+        return orientation_normal(width, height, x, y);
+    };
+
+    matrix_map result;
+    result.reserve(2 * half_panel_height * pixels_across);
+    for (size_t i = 0; i < half_panel_height; i++) {
+        for (const auto &panel : panels) {
+            for (size_t px = 0; px < panel.width; px++) {
+                result.push_back(canvas_index(panel, px, i));
+                result.push_back(
+                    canvas_index(panel, px, i + half_panel_height));
+            }
+        }
+    }
+    return result;
+}
+
+size_t reverse_bits(size_t value, size_t n_bits) {
+    size_t result = 0;
+    for (size_t j = 0; j < n_bits; j++) {
+        if (value & (size_t{1} << j))
+            result |= size_t{1} << (n_bits - j - 1);
+    }
+    return result;
+}
+
+// Order in which the address rows are scanned. Interlaced scans even rows,
+// then odd rows; bit reversed scans 0, n/2, n/4, 3n/4, ... so that
+// consecutively scanned rows are far apart on the panel.
+std::vector<size_t> make_addr_order(scan_order order, size_t n_addr_lines) {
+    size_t n_addr = 1u << n_addr_lines;
+    std::vector<size_t> result;
+    result.reserve(n_addr);
+    switch (order) {
+    case linear:
+        for (size_t i = 0; i < n_addr; i++)
+            result.push_back(i);
+        break;
+    case interlaced:
+        for (size_t i = 0; i < n_addr; i += 2)
+            result.push_back(i);
+        for (size_t i = 1; i < n_addr; i += 2)
+            result.push_back(i);
+        break;
+    case bit_reversed:
+        for (size_t i = 0; i < n_addr; i++)
+            result.push_back(reverse_bits(i, n_addr_lines));
+        break;
+    default:
+        throw std::range_error("invalid scan order");
+    }
+    return result;
+}
+
+void check_addr_order(const std::vector<size_t> &order, size_t n_addr_lines) {
+    size_t n_addr = 1u << n_addr_lines;
+    if (order.size() != n_addr) {
+        throw std::range_error("scan order must list each address row once");
+    }
+    std::vector<bool> seen(n_addr);
+    for (auto addr : order) {
+        if (addr >= n_addr || seen[addr]) {
+            throw std::range_error(
+                "scan order must list each address row once");
+        }
+        seen[addr] = true;
+    }
+}
+
+// A run of pixel pairs whose framebuffer indices both advance by `stride`
+struct map_run {
+    uint32_t start0, start1;
+    int32_t stride;
+    uint32_t count;
+};
+
+// The matrix map in the form used by the renderer. Regular layouts become a
+// few runs per address row, gathered with contiguous or strided loops;
+// anything else falls back to an index list, in 16 bits when the pixel count
+// allows.
+struct compiled_map {
+    compiled_map() = default;
+    compiled_map(const matrix_map &map, size_t pixels_across,
+                 size_t n_addr_lines) {
+        size_t n_addr = 1u << n_addr_lines;
+        size_t n_pairs = n_addr * pixels_across;
+        row_runs.reserve(n_addr + 1);
+        for (size_t addr = 0; addr < n_addr; addr++) {
+            row_runs.push_back(runs.size());
+            auto row = map.begin() + 2 * addr * pixels_across;
+            for (size_t x = 0; x < pixels_across;) {
+                map_run run{uint32_t(row[2 * x]), uint32_t(row[2 * x + 1]), 1,
+                            1};
+                if (x + 1 < pixels_across) {
+                    int32_t stride = row[2 * x + 2] - row[2 * x];
+                    if (row[2 * x + 3] - row[2 * x + 1] == stride) {
+                        run.stride = stride;
+                    }
+                }
+                while (x + run.count < pixels_across &&
+                       row[2 * (x + run.count)] ==
+                           int(run.start0 + run.count * run.stride) &&
+                       row[2 * (x + run.count) + 1] ==
+                           int(run.start1 + run.count * run.stride)) {
+                    run.count++;
+                }
+                runs.push_back(run);
+                x += run.count;
+            }
+        }
+        row_runs.push_back(runs.size());
+
+        for (const auto &run : runs) {
+            if (run.stride != 1 && run.stride != -1 && run.count > 1) {
+                sequential = false;
+            }
+        }
+
+        // runs only pay off when they are reasonably long
+        if (runs.size() * 4 <= n_pairs) {
+            return;
+        }
+        sequential = false;
+        runs.clear();
+        row_runs.clear();
+        int max_index = 0;
+        for (auto i : map) {
+            max_index = std::max(max_index, i);
+        }
+        if (max_index <= UINT16_MAX) {
+            index16.assign(map.begin(), map.end());
+        } else {
+            index32.assign(map.begin(), map.end());
+        }
+    }
+
+    // The map of pixels already gathered into scan order: for each address
+    // row, the first pixel of every pair followed by the second
+    static compiled_map make_scan_order_map(size_t pixels_across,
+                                            size_t n_addr_lines) {
+        compiled_map result;
+        size_t n_addr = 1u << n_addr_lines;
+        for (size_t addr = 0; addr < n_addr; addr++) {
+            uint32_t start = 2 * addr * pixels_across;
+            result.row_runs.push_back(addr);
+            result.runs.push_back(
+                {start, uint32_t(start + pixels_across), 1,
+                 uint32_t(pixels_across)});
+        }
+        result.row_runs.push_back(n_addr);
+        return result;
+    }
+
+    // Call f(pixel0, pixel1) for each pixel pair shifted out for `addr`
+    template <typename F>
+    void for_each_pair(size_t addr, size_t pixels_across,
+                       const uint32_t *pixels, F &&f) const {
+        if (!runs.empty()) {
+            for (size_t i = row_runs[addr]; i < row_runs[addr + 1]; i++) {
+                const auto &run = runs[i];
+                const uint32_t *p0 = pixels + run.start0;
+                const uint32_t *p1 = pixels + run.start1;
+                if (run.stride == 1) {
+                    for (uint32_t j = 0; j < run.count; j++) {
+                        f(p0[j], p1[j]);
+                    }
+                } else {
+                    for (uint32_t j = 0; j < run.count; j++) {
+                        f(*p0, *p1);
+                        p0 += run.stride;
+                        p1 += run.stride;
+                    }
+                }
+            }
+        } else if (!index16.empty()) {
+            gather(index16.data() + 2 * addr * pixels_across, pixels_across,
+                   pixels, f);
+        } else {
+            gather(index32.data() + 2 * addr * pixels_across, pixels_across,
+                   pixels, f);
+        }
+    }
+
+    std::vector<map_run> runs;
+    std::vector<uint32_t> row_runs;
+    std::vector<uint16_t> index16;
+    std::vector<uint32_t> index32;
+    // Whether gathering reads the framebuffer (close to) sequentially; if
+    // not, it is cheaper to transpose the frame into scan order once than to
+    // gather from it for every bit plane
+    bool sequential = true;
+
+  private:
+    template <typename T, typename F>
+    static void gather(const T *index, size_t pixels_across,
+                       const uint32_t *pixels, F &f) {
+        for (size_t x = 0; x < pixels_across; x++, index += 2) {
+            f(pixels[index[0]], pixels[index[1]]);
+        }
+    }
+};
+
 struct matrix_geometry {
     template <typename Cb>
     matrix_geometry(size_t pixels_across, size_t n_addr_lines, int n_planes,
                     size_t width, size_t height, bool serpentine, const Cb &cb)
+        : matrix_geometry(pixels_across, n_addr_lines, n_planes, width, height,
+                          make_matrixmap(width, height, n_addr_lines,
+                                         serpentine, cb)) {}
+
+    // `map` gives, for each address row and each pixel of the shift
+    // register, the framebuffer index of the pixel in the top half and then
+    // the one in the bottom half.
+    matrix_geometry(size_t pixels_across, size_t n_addr_lines, int n_planes,
+                    size_t width, size_t height, matrix_map map_in)
         : pixels_across(pixels_across), n_addr_lines(n_addr_lines),
-          n_planes(n_planes), width(width),
-          height(height), map{make_matrixmap(width, height, n_addr_lines,
-                                             serpentine, cb)} {
+          n_planes(n_planes), width(width), height(height),
+          map{std::move(map_in)} {
         size_t pixels_down = 2u << n_addr_lines;
         if (map.size() != pixels_down * pixels_across) {
             throw std::range_error(
                 "map size does not match calculated pixel count");
         }
+        for (auto i : map) {
+            if (i < 0 || size_t(i) >= width * height) {
+                throw std::range_error("map index outside the framebuffer");
+            }
+        }
+        compile();
+    }
+
+    // Rebuild the renderer's forms of `map` after changing it
+    void compile() {
+        compiled = compiled_map(map, pixels_across, n_addr_lines);
+        scan_map =
+            compiled_map::make_scan_order_map(pixels_across, n_addr_lines);
     }
     size_t pixels_across, n_addr_lines;
     int n_planes;
     size_t width, height;
     matrix_map map;
+    compiled_map compiled;
+    // Used instead of `compiled` once the frame is gathered into scan order
+    compiled_map scan_map;
+    // Split the most significant planes into 2**plane_spread shorter slices,
+    // spread over as many scans of the address rows
+    int plane_spread = 0;
+    // Order in which the address rows are scanned; empty for 0..n_addr-1
+    std::vector<size_t> addr_order;
+    // Render 2**n_temporal_planes refreshes per frame, each rounding the
+    // bits below the n_planes displayed planes differently, so that their
+    // average shows n_planes + n_temporal_planes bits of depth
+    int n_temporal_planes = 0;
+    // Spatially dither converted pixels down to the displayed depth
+    dither_mode dither = no_dither;
+    // Scale the /OE on-time of all rows, and of each address row
+    double brightness = 1.0;
+    std::vector<double> row_brightness;
 };
+
+// The same geometry, for a framebuffer that is a canvas of canvas_width x
+// canvas_height pixels with the display in its top left corner. Other parts
+// of the canvas are shown by offsetting the pixel data by the position of
+// the viewport.
+matrix_geometry canvas_geometry(const matrix_geometry &geometry,
+                                size_t canvas_width, size_t canvas_height) {
+    if (canvas_width < geometry.width || canvas_height < geometry.height) {
+        throw std::range_error("canvas is smaller than the display");
+    }
+    matrix_geometry result = geometry;
+    for (auto &i : result.map) {
+        i = i % geometry.width + i / geometry.width * canvas_width;
+    }
+    result.width = canvas_width;
+    result.height = canvas_height;
+    result.compile();
+    return result;
+}
+
+// The geometry of a chain of identical panels covering `width` by `height`
+// pixels, showing `n_planes` bit planes and `n_temporal_planes` more by
+// temporal dithering
+matrix_geometry make_panel_geometry(size_t width, size_t height,
+                                    size_t n_addr_lines, bool serpentine,
+                                    orientation rotation, int n_planes,
+                                    int n_temporal_planes = 0) {
+    size_t n_lines = 2 << n_addr_lines;
+    if ((width * height) % n_lines) {
+        throw std::range_error(
+            "total pixel count must be a multiple of the row addresses");
+    }
+    if (n_planes < 1 || n_temporal_planes < 0 ||
+        n_planes + n_temporal_planes > 10) {
+        throw std::range_error(
+            "n_planes + n_temporal_planes must be from 1 to 10");
+    }
+    size_t pixels_across = width * height / n_lines;
+    auto make = [&](auto cb) {
+        matrix_geometry result(pixels_across, n_addr_lines, n_planes, width,
+                               height, serpentine, cb);
+        result.n_temporal_planes = n_temporal_planes;
+        return result;
+    };
+    switch (rotation) {
+    case normal:
+        return make(orientation_normal);
+    case r180:
+        return make(orientation_r180);
+    case ccw:
+        return make(orientation_ccw);
+    case cw:
+        return make(orientation_cw);
+    }
+    throw std::runtime_error("invalid orientation");
+}
 } // namespace piomatter
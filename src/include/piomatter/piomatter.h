@@ -1,6 +1,11 @@
 #pragma once
 
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sys/eventfd.h>
 #include <thread>
+#include <unistd.h>
 
 #include "hardware/pio.h"
 
@@ -9,6 +14,8 @@
 #include "piomatter/pins.h"
 #include "piomatter/protomatter.pio.h"
 #include "piomatter/render.h"
+#include "piomatter/streamfile.h"
+#include "piomatter/yuv.h"
 
 namespace piomatter {
 
@@ -20,6 +27,12 @@ static uint64_t monotonicns64() {
 
 constexpr size_t MAX_XFER = 65532;
 
+// Due to https://github.com/raspberrypi/utils/issues/116 it's not possible to
+// keep the RP1 state machine fed at high rates. This target frequency is
+// approximately the best sustainable clock with current FW & kernel.
+constexpr double pio_target_freq =
+    2700000 * 2; // 2.7MHz pixel clock, 2 PIO cycles per pixel
+
 void pio_sm_xfer_data_large(PIO pio, int sm, int direction, size_t size,
                             uint32_t *databuf) {
     while (size) {
@@ -34,24 +47,107 @@ void pio_sm_xfer_data_large(PIO pio, int sm, int direction, size_t size,
     }
 }
 
+// Pixel formats that any display can show, whatever its own colorspace
+enum class pixel_format { rgb565, rgb888_packed };
+
 struct piomatter_base {
-    piomatter_base() {}
+    piomatter_base()
+        : buffer_available_fd{eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)},
+          presented_fd{eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)} {
+        if (buffer_available_fd < 0 || presented_fd < 0) {
+            close_events();
+            throw std::runtime_error("eventfd");
+        }
+    }
     piomatter_base(const piomatter_base &) = delete;
     piomatter_base &operator=(const piomatter_base &) = delete;
 
-    virtual ~piomatter_base() {}
-    virtual void show() = 0;
+    virtual ~piomatter_base() { close_events(); }
+    // Show the framebuffer. A frame with a `present_at` time, in ns on the
+    // monotonic clock, replaces the one on display at the first refresh that
+    // starts after that time, and 0 means as soon as possible. Returns the
+    // frame's sequence number, as reported by last_presented().
+    virtual uint64_t show(uint64_t present_at = 0) = 0;
+    // Show another framebuffer of the same shape and colorspace, given as
+    // bytes; it is only read during the call
+    virtual uint64_t show(const framebuffer_view<uint8_t> &framebuffer,
+                          uint64_t present_at = 0) = 0;
+    // Show a frame in a given pixel format, whatever the colorspace, for
+    // sources with a fixed pixel format such as network protocols and video
+    virtual uint64_t show_as(pixel_format format,
+                             const framebuffer_view<uint8_t> &frame,
+                             uint64_t present_at = 0) = 0;
+    uint64_t show_rgb888(const framebuffer_view<uint8_t> &frame) {
+        return show_as(pixel_format::rgb888_packed, frame);
+    }
+    // Show a YUV 4:2:0 frame of the display's size, such as decoded video
+    virtual uint64_t show_yuv(const yuv_frame &frame,
+                              const yuv_encoding &encoding,
+                              uint64_t present_at = 0) = 0;
+    virtual void set_brightness(double brightness,
+                                const std::vector<double> &row_brightness) = 0;
+    virtual void set_calibration(const color_calibration &calibration) = 0;
+    // Convert a canvas at least as large as the display, given as bytes;
+    // show_viewport() then shows part of it without converting it again
+    virtual void set_canvas(const framebuffer_view<uint8_t> &canvas) = 0;
+    virtual void show_viewport(size_t x, size_t y) = 0;
+    // Render a sequence of frames once, and let the blitter thread play them,
+    // each for its duration in seconds; any show() stops the animation
+    virtual void play(const std::vector<framebuffer_view<uint8_t>> &frames,
+                      const std::vector<double> &durations, bool loop) = 0;
+    // Play the streams of a stream file rendered for this pinout and geometry
+    virtual void play(std::shared_ptr<stream_file> file, bool loop) = 0;
+    virtual void stop_animation() = 0;
+
+    // The sequence number of the frame on display, and the time at which
+    // the blitter started sending it
+    struct presentation {
+        uint64_t sequence = 0;
+        uint64_t time = 0;
+    };
+    virtual presentation last_presented() = 0;
+    virtual bool buffer_available() = 0;
 
     double fps;
+    double pwm_frequency = 0;
+
+    // Event fds that become readable when the blitter frees a buffer, and
+    // when it presents a new frame. Reading one resets it.
+    int buffer_available_fd, presented_fd;
+
+  protected:
+    static void signal_event(int fd) {
+        uint64_t one = 1;
+        // can only fail when the count would overflow, and it's still set
+        [[maybe_unused]] auto r = write(fd, &one, sizeof(one));
+    }
+
+  private:
+    void close_events() {
+        for (int fd : {buffer_available_fd, presented_fd}) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
 };
 
 template <class pinout = adafruit_matrix_bonnet_pinout,
           class colorspace = colorspace_rgb888>
 struct piomatter : piomatter_base {
     using buffer_type = std::vector<uint32_t>;
-    piomatter(std::span<typename colorspace::data_type const> framebuffer,
+    using data_type = typename colorspace::data_type;
+    piomatter(std::span<data_type const> framebuffer,
+              const matrix_geometry &geometry)
+        : piomatter(framebuffer_view<data_type>{
+                        framebuffer, geometry.width,
+                        colorspace::data_size_in_bytes(1)},
+                    geometry) {}
+
+    // The framebuffer may also be a strided view into a larger canvas
+    piomatter(const framebuffer_view<data_type> &framebuffer,
               const matrix_geometry &geometry)
-        : framebuffer(framebuffer), geometry{geometry}, converter{},
+        : framebuffer(framebuffer), geometry{geometry}, converter{geometry},
           blitter_thread{&piomatter::blit_thread, this} {
         if (geometry.n_addr_lines > std::size(pinout::PIN_ADDR)) {
             throw std::runtime_error("too many address lines requested");
@@ -60,12 +156,232 @@ struct piomatter : piomatter_base {
         show();
     }
 
-    void show() override {
+    uint64_t show(uint64_t present_at = 0) override {
+        return show_framebuffer(framebuffer, present_at);
+    }
+
+    uint64_t show(const framebuffer_view<uint8_t> &other,
+                  uint64_t present_at = 0) override {
+        return show_framebuffer(other.template as<data_type>(), present_at);
+    }
+
+    uint64_t show_framebuffer(const framebuffer_view<data_type> &source,
+                              uint64_t present_at) {
+        std::lock_guard<std::mutex> lock(render_mutex);
+        auto converted = converter.convert(source);
+        return render(geometry, converted.data(), present_at);
+    }
+
+    uint64_t show_as(pixel_format format,
+                     const framebuffer_view<uint8_t> &frame,
+                     uint64_t present_at = 0) override {
+        std::lock_guard<std::mutex> lock(render_mutex);
+        switch (format) {
+        case pixel_format::rgb565:
+            return show_converted(rgb565_converter, frame, present_at);
+        case pixel_format::rgb888_packed:
+            return show_converted(rgb888_converter, frame, present_at);
+        }
+        throw std::runtime_error("invalid pixel format");
+    }
+
+    uint64_t show_yuv(const yuv_frame &frame, const yuv_encoding &encoding,
+                      uint64_t present_at = 0) override {
+        if (frame.width != geometry.width || frame.height != geometry.height) {
+            throw std::runtime_error("YUV frame must have the display's size");
+        }
+        std::lock_guard<std::mutex> lock(render_mutex);
+        if (!yuv_converter) {
+            yuv_converter.emplace(geometry, encoding);
+            if (calibration) {
+                yuv_converter->set_calibration(*calibration);
+            }
+        } else if (yuv_converter->encoding != encoding) {
+            yuv_converter->set_encoding(encoding);
+        }
+        auto converted = yuv_converter->convert(frame);
+        return render(geometry, converted.data(), present_at);
+    }
+
+    // Convert a frame with one of the show_as() converters, creating it
+    // first if need be; render_mutex must be held
+    template <typename source_colorspace>
+    uint64_t show_converted(std::optional<source_colorspace> &source_converter,
+                            const framebuffer_view<uint8_t> &frame,
+                            uint64_t present_at) {
+        if (!source_converter) {
+            source_converter.emplace(geometry);
+            if (calibration) {
+                source_converter->set_calibration(*calibration);
+            }
+        }
+        auto converted = source_converter->convert(
+            frame.template as<typename source_colorspace::data_type>());
+        return render(geometry, converted.data(), present_at);
+    }
+
+    void set_canvas(const framebuffer_view<uint8_t> &canvas) override {
+        std::lock_guard<std::mutex> lock(render_mutex);
+        if (!canvas_map || canvas.width != canvas_map->width ||
+            canvas.height != canvas_map->height) {
+            canvas_map = canvas_geometry(geometry, canvas.width, canvas.height);
+            canvas_converter.emplace(*canvas_map);
+            if (calibration) {
+                canvas_converter->set_calibration(*calibration);
+            }
+        }
+        auto converted =
+            canvas_converter->convert(canvas.template as<data_type>());
+        canvas_pixels.assign(converted.begin(), converted.end());
+    }
+
+    // The viewport is just an offset into the converted canvas
+    void show_viewport(size_t x, size_t y) override {
+        std::lock_guard<std::mutex> lock(render_mutex);
+        if (canvas_pixels.empty()) {
+            throw std::runtime_error("no canvas has been set");
+        }
+        if (x + geometry.width > canvas_map->width ||
+            y + geometry.height > canvas_map->height) {
+            throw std::range_error("viewport extends outside the canvas");
+        }
+        render(*canvas_map, canvas_pixels.data() + y * canvas_map->width + x);
+    }
+
+    void play(const std::vector<framebuffer_view<uint8_t>> &frames,
+              const std::vector<double> &durations, bool loop) override {
+        if (frames.empty() || frames.size() != durations.size()) {
+            throw std::runtime_error(
+                "an animation needs one duration for each of its frames");
+        }
+        auto new_animation = std::make_shared<animation>();
+        new_animation->loop = loop;
+        for (auto duration : durations) {
+            if (!(duration > 0)) {
+                throw std::range_error("frame durations must be positive");
+            }
+            new_animation->durations.push_back(uint64_t(duration * 1e9));
+        }
+
+        std::lock_guard<std::mutex> lock(render_mutex);
+        new_animation->rendered.resize(frames.size());
+        for (size_t i = 0; i < frames.size(); i++) {
+            auto converted =
+                converter.convert(frames[i].template as<data_type>());
+            auto &stream = new_animation->rendered[i];
+            protomatter_render_rgb10<pinout>(stream, geometry,
+                                             converted.data());
+            new_animation->streams.push_back(stream);
+        }
+        std::lock_guard<std::mutex> animation_lock(animation_mutex);
+        playing = std::move(new_animation);
+    }
+
+    // The streams are played straight from the mapped file, unless the
+    // brightness has been changed
+    void play(std::shared_ptr<stream_file> file, bool loop) override {
+        if (!file->header().matches(stream_file_header::of(
+                stream_file_pinout::of<pinout>(), geometry))) {
+            throw std::runtime_error(
+                "stream file was rendered for another pinout or geometry");
+        }
+        auto new_animation = std::make_shared<animation>();
+        new_animation->loop = loop;
+        for (size_t i = 0; i < file->size(); i++) {
+            new_animation->streams.push_back(file->stream(i));
+            new_animation->durations.push_back(file->duration(i));
+        }
+        new_animation->file = std::move(file);
+
+        std::lock_guard<std::mutex> lock(render_mutex);
+        if (geometry.brightness != 1 || !geometry.row_brightness.empty()) {
+            for (auto stream : new_animation->streams) {
+                protomatter_update_brightness<pinout>(stream, geometry);
+            }
+        }
+        std::lock_guard<std::mutex> animation_lock(animation_mutex);
+        playing = std::move(new_animation);
+    }
+
+    // The blitter goes back to the last frame shown
+    void stop_animation() override {
+        std::lock_guard<std::mutex> lock(animation_mutex);
+        playing.reset();
+    }
+
+    // Render into a free buffer and queue it; render_mutex must be held
+    uint64_t render(const matrix_geometry &source_geometry,
+                    const uint32_t *pixels, uint64_t present_at = 0) {
         int buffer_idx = manager.get_free_buffer();
         auto &buffer = buffers[buffer_idx];
-        auto converted = converter.convert(framebuffer);
-        protomatter_render_rgb10<pinout>(buffer, geometry, converted.data());
+        protomatter_render_rgb10<pinout>(buffer, source_geometry, pixels);
+        // the stream timing does not depend on the pixel data
+        if (!pwm_frequency) {
+            pwm_frequency = pio_target_freq * schedule_scans(geometry) *
+                            refreshes_per_buffer /
+                            protomatter_stream_cycles(buffer);
+        }
+        stop_animation();
+        buffer_sequence[buffer_idx] = ++frames_queued;
+        buffer_present_at[buffer_idx] = present_at;
         manager.put_filled_buffer(buffer_idx);
+        return frames_queued;
+    }
+
+    bool buffer_available() override { return manager.has_free_buffer(); }
+
+    presentation last_presented() override {
+        std::lock_guard<std::mutex> lock(presented_mutex);
+        return presented;
+    }
+
+    // Change the /OE on-time of the rendered streams in place, including
+    // the one currently being displayed. Each stream is patched between
+    // transfers, so that no refresh mixes old and new timing.
+    void set_brightness(double brightness,
+                        const std::vector<double> &row_brightness) override {
+        std::lock_guard<std::mutex> lock(render_mutex);
+        geometry.brightness = brightness;
+        geometry.row_brightness = row_brightness;
+        if (canvas_map) {
+            canvas_map->brightness = brightness;
+            canvas_map->row_brightness = row_brightness;
+        }
+        for (auto &buffer : buffers) {
+            // buffers are empty until the first frames are rendered into them
+            if (buffer.empty()) {
+                continue;
+            }
+            std::lock_guard<std::mutex> xfer_lock(xfer_mutex);
+            protomatter_update_brightness<pinout>(buffer, geometry);
+        }
+        std::lock_guard<std::mutex> animation_lock(animation_mutex);
+        if (playing) {
+            for (auto &stream : playing->streams) {
+                std::lock_guard<std::mutex> xfer_lock(xfer_mutex);
+                protomatter_update_brightness<pinout>(stream, geometry);
+            }
+        }
+    }
+
+    // Replace the conversion tables; takes effect at the next show()
+    void set_calibration(const color_calibration &calibration) override {
+        calibration.check();
+        std::lock_guard<std::mutex> lock(render_mutex);
+        converter.set_calibration(calibration);
+        if (canvas_converter) {
+            canvas_converter->set_calibration(calibration);
+        }
+        if (rgb565_converter) {
+            rgb565_converter->set_calibration(calibration);
+        }
+        if (rgb888_converter) {
+            rgb888_converter->set_calibration(calibration);
+        }
+        if (yuv_converter) {
+            yuv_converter->set_calibration(calibration);
+        }
+        this->calibration = calibration;
     }
 
     ~piomatter() {
@@ -124,13 +440,7 @@ struct piomatter : piomatter_base {
         sm_config_set_out_shift(&c, /* shift_right= */ false,
                                 /* auto_pull = */ true, 32);
         sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_TX);
-        // Due to https://github.com/raspberrypi/utils/issues/116 it's not
-        // possible to keep the RP1 state machine fed at high rates. This target
-        // frequency is approximately the best sustainable clock with current
-        // FW & kernel.
-        constexpr double target_freq =
-            2700000 * 2; // 2.7MHz pixel clock, 2 PIO cycles per pixel
-        double div = clock_get_hz(clk_sys) / target_freq;
+        double div = clock_get_hz(clk_sys) / pio_target_freq;
         sm_config_set_clkdiv(&c, div);
         sm_config_set_out_pins(&c, 0, 28);
         sm_config_set_sideset_pins(&c, pinout::PIN_CLK);
@@ -159,30 +469,96 @@ struct piomatter : piomatter_base {
         pio_sm_set_consecutive_pindirs(pio, sm, pin, 1, false);
     }
 
+    struct animation {
+        std::vector<std::span<uint32_t>> streams;
+        std::vector<uint64_t> durations; // in ns
+        bool loop;
+        // what holds the streams: rendered here, or mapped from a file
+        std::vector<buffer_type> rendered;
+        std::shared_ptr<stream_file> file;
+    };
+
+    std::shared_ptr<animation> current_animation() {
+        std::lock_guard<std::mutex> lock(animation_mutex);
+        return playing;
+    }
+
     void blit_thread() {
         const uint32_t *databuf = nullptr;
         size_t datasize = 0;
         int old_buffer_idx = buffer_manager::no_buffer;
         int buffer_idx;
         uint64_t t0, t1;
+        // the animation being played, its current frame and when that ends
+        std::shared_ptr<animation> anim;
+        size_t frame = 0;
+        uint64_t frame_end = 0;
+        // a filled buffer waiting for its presentation time
+        int pending_idx = buffer_manager::no_buffer;
         t0 = monotonicns64();
-        while ((buffer_idx = manager.get_filled_buffer()) !=
-               buffer_manager::exit_request) {
+        while (!manager.exit_requested()) {
+            if (pending_idx == buffer_manager::no_buffer) {
+                pending_idx = manager.get_filled_buffer();
+            }
+            if (pending_idx == buffer_manager::exit_request) {
+                break;
+            }
+            buffer_idx = buffer_manager::no_buffer;
+            if (pending_idx != buffer_manager::no_buffer &&
+                monotonicns64() >= buffer_present_at[pending_idx]) {
+                buffer_idx = pending_idx;
+                pending_idx = buffer_manager::no_buffer;
+            }
             if (buffer_idx != buffer_manager::no_buffer) {
                 const auto &buffer = buffers[buffer_idx];
                 databuf = &buffer[0];
                 datasize = buffer.size() * sizeof(*databuf);
                 if (old_buffer_idx != buffer_manager::no_buffer) {
                     manager.put_free_buffer(old_buffer_idx);
+                    signal_event(buffer_available_fd);
                 }
                 old_buffer_idx = buffer_idx;
             }
-            if (datasize) {
-                pio_sm_xfer_data_large(pio, sm, PIO_DIR_TO_SM, datasize,
-                                       (uint32_t *)databuf);
+
+            auto latest = current_animation();
+            if (latest != anim) {
+                anim = std::move(latest);
+                frame = 0;
+                frame_end = anim ? monotonicns64() + anim->durations[0] : 0;
+            } else if (anim) {
+                // Frame changes are counted from when the animation started,
+                // so they don't drift; frames shorter than a refresh are
+                // skipped
+                uint64_t now = monotonicns64();
+                size_t n_frames = anim->streams.size();
+                while (now >= frame_end &&
+                       (anim->loop || frame + 1 < n_frames)) {
+                    frame = (frame + 1) % n_frames;
+                    frame_end += anim->durations[frame];
+                }
+            }
+
+            const uint32_t *xfer_data = databuf;
+            size_t xfer_size = datasize;
+            if (anim) {
+                const auto &stream = anim->streams[frame];
+                xfer_data = stream.data();
+                xfer_size = stream.size() * sizeof(*xfer_data);
+            }
+            if (xfer_size) {
+                if (buffer_idx != buffer_manager::no_buffer) {
+                    std::lock_guard<std::mutex> lock(presented_mutex);
+                    presented = {buffer_sequence[buffer_idx], monotonicns64()};
+                    signal_event(presented_fd);
+                }
+                {
+                    std::lock_guard<std::mutex> lock(xfer_mutex);
+                    pio_sm_xfer_data_large(pio, sm, PIO_DIR_TO_SM, xfer_size,
+                                           (uint32_t *)xfer_data);
+                }
                 t1 = monotonicns64();
                 if (t0 != t1) {
-                    fps = 1e9 / (t1 - t0);
+                    fps = 1e9 * refreshes_per_buffer / (t1 - t0);
                 }
                 t0 = t1;
             } else {
@@ -193,11 +569,35 @@ struct piomatter : piomatter_base {
 
     PIO pio = NULL;
     int sm = -1;
-    std::span<typename colorspace::data_type const> framebuffer;
+    framebuffer_view<data_type> framebuffer;
     buffer_type buffers[3];
     buffer_manager manager{};
+    // the sequence number and presentation time of each buffer's frame
+    uint64_t buffer_sequence[3] = {}, buffer_present_at[3] = {};
+    uint64_t frames_queued = 0;
+    std::mutex presented_mutex;
+    presentation presented;
+    std::mutex render_mutex;
+    // held by the blitter while it sends a stream, and by set_brightness()
+    // while it patches one
+    std::mutex xfer_mutex;
     matrix_geometry geometry;
+    // with temporal dithering, each buffer holds several refreshes
+    size_t refreshes_per_buffer = size_t{1} << temporal_planes(geometry);
     colorspace converter;
+    std::optional<color_calibration> calibration;
+    // the virtual canvas: its geometry, converter and converted pixels
+    std::optional<matrix_geometry> canvas_map;
+    std::optional<colorspace> canvas_converter;
+    std::vector<uint32_t> canvas_pixels;
+    // for show_as(), created when first used
+    std::optional<colorspace_rgb565> rgb565_converter;
+    std::optional<colorspace_rgb888_packed> rgb888_converter;
+    // for show_yuv(), likewise
+    std::optional<yuv420_converter> yuv_converter;
+    // the animation being played, if any, shared with the blitter thread
+    std::mutex animation_mutex;
+    std::shared_ptr<animation> playing;
     std::thread blitter_thread;
 };
 
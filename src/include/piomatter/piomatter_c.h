@@ -0,0 +1,120 @@
+#pragma once
+
+// A C interface to piomatter, for programs that don't use Python or C++. It
+// is implemented by libpiomatter.so; see libpiomatter.c.
+//
+// Functions returning int return 0 on success and -1 on failure, after which
+// piomatter_last_error() describes what went wrong.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum piomatter_pinout {
+    PIOMATTER_PINOUT_ADAFRUIT_BONNET,
+    PIOMATTER_PINOUT_ADAFRUIT_BONNET_BGR,
+};
+
+enum piomatter_colorspace {
+    PIOMATTER_COLORSPACE_RGB565,        // 2 bytes per pixel
+    PIOMATTER_COLORSPACE_RGB888,        // 4 bytes per pixel, 0x00RRGGBB
+    PIOMATTER_COLORSPACE_RGB888_PACKED, // 3 bytes per pixel, R, G, B
+};
+
+enum piomatter_orientation {
+    PIOMATTER_ORIENTATION_NORMAL,
+    PIOMATTER_ORIENTATION_R180,
+    PIOMATTER_ORIENTATION_CCW,
+    PIOMATTER_ORIENTATION_CW,
+};
+
+enum piomatter_video_format {
+    PIOMATTER_VIDEO_RGB888_PACKED, // raw frames, 3 bytes per pixel
+    PIOMATTER_VIDEO_RGB565,        // raw frames, 2 bytes per pixel
+    PIOMATTER_VIDEO_Y4M,           // YUV4MPEG2 with 4:2:0 chroma
+    PIOMATTER_VIDEO_I420,          // raw frames of Y, U and V planes
+    PIOMATTER_VIDEO_NV12,          // raw frames of Y and interleaved UV planes
+};
+
+enum piomatter_yuv_matrix {
+    PIOMATTER_YUV_BT601,
+    PIOMATTER_YUV_BT709,
+};
+
+struct piomatter_config {
+    size_t width, height, n_addr_lines;
+    int n_planes, n_temporal_planes, plane_spread;
+    int serpentine;
+    enum piomatter_orientation orientation;
+    enum piomatter_pinout pinout;
+    enum piomatter_colorspace colorspace;
+    double brightness;
+};
+
+struct piomatter_video_options {
+    enum piomatter_video_format format;
+    double fps; // of raw frames; YUV4MPEG2 streams declare their own
+    int drop_late, loop;
+    // how YUV encodes RGB; YUV4MPEG2 streams may declare their range
+    enum piomatter_yuv_matrix yuv_matrix;
+    int full_range;
+};
+
+struct piomatter_video_stats {
+    uint64_t frames, frames_late, frames_dropped;
+};
+
+typedef struct piomatter_handle piomatter_handle;
+
+// Fill in the defaults: a 64x32 panel on an Adafruit bonnet, taking packed
+// RGB888 pixels
+void piomatter_config_init(struct piomatter_config *config);
+
+// Bytes per pixel of a colorspace
+size_t piomatter_pixel_size(enum piomatter_colorspace colorspace);
+
+// Claim the hardware and start refreshing a black frame. Returns NULL on
+// failure, with a message in `error` if it isn't NULL.
+piomatter_handle *piomatter_create(const struct piomatter_config *config,
+                                   char *error, size_t error_size);
+void piomatter_destroy(piomatter_handle *handle);
+
+// Show a frame of height rows of width pixels in the configured colorspace,
+// with rows `row_pitch` bytes apart; 0 means packed rows. The frame is only
+// read during the call.
+int piomatter_show(piomatter_handle *handle, const void *frame,
+                   ptrdiff_t row_pitch);
+
+int piomatter_set_brightness(piomatter_handle *handle, double brightness);
+
+// Approximate refreshes per second, and the predicted number of times per
+// second each row is scanned
+double piomatter_fps(const piomatter_handle *handle);
+double piomatter_pwm_frequency(const piomatter_handle *handle);
+
+// Fill in the defaults: YUV4MPEG2, or raw frames at 30 per second, with
+// limited range BT.601 YUV
+void piomatter_video_options_init(struct piomatter_video_options *options);
+
+// Start showing video read from `fd` by threads of the library, replacing
+// any video already playing. With `drop_late`, a frame that is ready only
+// once the next one is due is skipped, though never two in a row; with
+// `loop`, a file is rewound at its end. The descriptor must stay open until
+// the video is stopped.
+int piomatter_play_fd(piomatter_handle *handle, int fd,
+                      const struct piomatter_video_options *options);
+// Wait up to `timeout` seconds for the video to end. Returns 1 if it has
+// ended, 0 if not, and -1 if it ended because of an error.
+int piomatter_video_wait(piomatter_handle *handle, double timeout);
+int piomatter_video_stats(piomatter_handle *handle,
+                          struct piomatter_video_stats *stats);
+void piomatter_stop_video(piomatter_handle *handle);
+
+const char *piomatter_last_error(const piomatter_handle *handle);
+
+#ifdef __cplusplus
+}
+#endif
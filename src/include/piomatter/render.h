@@ -1,7 +1,11 @@
 #pragma once
 
+#include "framebuffer.h"
 #include "matrixmap.h"
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cmath>
 #include <span>
 #include <vector>
 
@@ -15,6 +19,11 @@ constexpr int CLOCKS_PER_DELAY = 1;
 constexpr uint32_t command_data = 1u << 31;
 constexpr uint32_t command_delay = 0;
 
+// Number of temporally dithered planes actually used
+int temporal_planes(const matrix_geometry &geometry) {
+    return std::clamp(geometry.n_temporal_planes, 0, 10 - geometry.n_planes);
+}
+
 struct gamma_lut {
     gamma_lut(double exponent = 2.2) {
         for (int i = 0; i < 256; i++) {
@@ -71,17 +80,409 @@ struct gamma_lut {
     uint16_t lut[256];
 };
 
+// Color calibration folded into the conversion tables
+struct color_calibration {
+    color_calibration(double gamma = 2.2) : gamma{gamma, gamma, gamma} {}
+
+    // exponent of each input channel's transfer curve
+    std::array<double, 3> gamma;
+    // applied to the linear values; white balance gains are its diagonal
+    std::array<double, 9> matrix{1, 0, 0, 0, 1, 0, 0, 0, 1};
+    // gains for each panel_width x panel_height tile of the framebuffer, in
+    // row-major order. Tiles past the end of the list are not adjusted.
+    size_t panel_width = 0, panel_height = 0;
+    std::vector<std::array<double, 3>> panel_gains;
+
+    // Throw unless the gammas are positive and every gain is finite, as the
+    // tables need
+    void check() const {
+        for (auto g : gamma) {
+            if (!(g > 0) || !std::isfinite(g)) {
+                throw std::range_error("gamma must be positive");
+            }
+        }
+        auto finite = [](double v) { return std::isfinite(v); };
+        if (!std::all_of(matrix.begin(), matrix.end(), finite)) {
+            throw std::range_error("color matrix and white balance must be "
+                                   "finite");
+        }
+        for (const auto &gains : panel_gains) {
+            if (!std::all_of(gains.begin(), gains.end(), finite)) {
+                throw std::range_error("panel gains must be finite");
+            }
+        }
+    }
+
+    bool is_diagonal() const {
+        return !matrix[1] && !matrix[2] && !matrix[3] && !matrix[5] &&
+               !matrix[6] && !matrix[7];
+    }
+
+    // linear value of an 8-bit input, in rgb10 units
+    double linear(int channel, unsigned v) const {
+        return std::max(double(v), 1023 * pow(v / 255., gamma[channel]));
+    }
+};
+
+// Per-channel tables holding each converted value already shifted to its
+// place in rgb10, so that converting a pixel is three loads and two ORs.
+// Used when the calibration has no cross terms between channels.
+struct rgb888_lut {
+    rgb888_lut(const color_calibration &calibration,
+               const std::array<double, 3> &gain = {1, 1, 1}) {
+        const auto &m = calibration.matrix;
+        for (unsigned i = 0; i < 256; i++) {
+            r[i] = channel(calibration.linear(0, i) * m[0] * gain[0]) << 20;
+            g[i] = channel(calibration.linear(1, i) * m[4] * gain[1]) << 10;
+            b[i] = channel(calibration.linear(2, i) * m[8] * gain[2]);
+        }
+    }
+
+    static uint32_t channel(double v) {
+        return std::clamp(int(round(v)), 0, 1023);
+    }
+
+    uint32_t convert(uint32_t r8, uint32_t g8, uint32_t b8) const {
+        return r[r8] | g[g8] | b[b8];
+    }
+
+    uint32_t r[256], g[256], b[256];
+};
+
+// Tables of each input channel's contribution to each output channel, in
+// 1/16 rgb10 units, for a calibration with a full color matrix
+struct matrix_lut {
+    matrix_lut(const color_calibration &calibration,
+               const std::array<double, 3> &gain = {1, 1, 1}) {
+        for (int out = 0; out < 3; out++) {
+            for (int in = 0; in < 3; in++) {
+                double k = calibration.matrix[out * 3 + in] * gain[out] * 16;
+                for (unsigned v = 0; v < 256; v++) {
+                    t[out][in][v] = round(k * calibration.linear(in, v));
+                }
+            }
+        }
+    }
+
+    uint32_t channel(int out, uint32_t r8, uint32_t g8, uint32_t b8) const {
+        int32_t v = (t[out][0][r8] + t[out][1][g8] + t[out][2][b8] + 8) >> 4;
+        return std::clamp(v, 0, 1023);
+    }
+
+    uint32_t convert(uint32_t r8, uint32_t g8, uint32_t b8) const {
+        return (channel(0, r8, g8, b8) << 20) |
+               (channel(1, r8, g8, b8) << 10) | channel(2, r8, g8, b8);
+    }
+
+    int32_t t[3][3][256];
+};
+
+// The conversion tables for a calibration: one set per panel tile with a
+// gain, plus one for the rest of the framebuffer.
+struct calibrated_lut {
+    calibrated_lut(const color_calibration &calibration, size_t width)
+        : width{width}, panel_width{calibration.panel_width},
+          panel_height{calibration.panel_height} {
+        const auto &gains = calibration.panel_gains;
+        if (gains.empty() || !width || !panel_width || !panel_height) {
+            panel_width = panel_height = 0;
+        } else {
+            panels_across = (width + panel_width - 1) / panel_width;
+            n_tiles = gains.size();
+        }
+        auto add = [&](const std::array<double, 3> &gain) {
+            if (calibration.is_diagonal()) {
+                channels.emplace_back(calibration, gain);
+            } else {
+                matrices.emplace_back(calibration, gain);
+            }
+        };
+        for (size_t i = 0; i < n_tiles; i++) {
+            add(gains[i]);
+        }
+        add({1, 1, 1});
+    }
+
+    bool single() const { return !n_tiles; }
+
+    // Convert the pixels of `view`, where `source(p)` gives the 8-bit
+    // components of the pixel at p as an array. With a `scale` above 1, each
+    // result pixel is the average of a block of scale x scale pixels.
+    template <typename T, typename Source>
+    void convert(std::vector<uint32_t> &result,
+                 const framebuffer_view<T> &view, const Source &source,
+                 size_t scale = 1) const {
+        if (scale > 1) {
+            if (channels.size()) {
+                downscale(channels, result, view, source, scale);
+            } else {
+                downscale(matrices, result, view, source, scale);
+            }
+            return;
+        }
+        result.resize(view.size());
+        if (channels.size()) {
+            convert_tiles(channels, result, view, source);
+        } else {
+            convert_tiles(matrices, result, view, source);
+        }
+    }
+
+    // Convert a single pixel with the tables for the top left tile
+    uint32_t convert(uint32_t r8, uint32_t g8, uint32_t b8) const {
+        return channels.size() ? channels[0].convert(r8, g8, b8)
+                               : matrices[0].convert(r8, g8, b8);
+    }
+
+    template <typename Lut, typename T, typename Source>
+    void convert_tiles(const std::vector<Lut> &tables,
+                       std::vector<uint32_t> &result,
+                       const framebuffer_view<T> &view,
+                       const Source &source) const {
+        uint32_t *out = result.data();
+        for (size_t y = 0; y < view.height; y++) {
+            const T *p = view.row(y);
+            if (single()) {
+                const auto &lut = tables[0];
+                for (size_t x = 0; x < view.width; x++, p = view.next(p)) {
+                    auto [r, g, b] = source(p);
+                    *out++ = lut.convert(r, g, b);
+                }
+                continue;
+            }
+            // walk the row one tile-wide run at a time
+            size_t tile = y / panel_height * panels_across;
+            for (size_t x = 0; x < view.width; tile++) {
+                const auto &lut = tables[std::min(tile, n_tiles)];
+                size_t run_end =
+                    std::min(x + panel_width - x % panel_width, view.width);
+                for (; x < run_end; x++, p = view.next(p)) {
+                    auto [r, g, b] = source(p);
+                    *out++ = lut.convert(r, g, b);
+                }
+            }
+        }
+    }
+
+    // The rgb10 values are linear, so averaging them averages light rather
+    // than gamma-encoded values
+    template <typename Lut, typename T, typename Source>
+    void downscale(const std::vector<Lut> &tables,
+                   std::vector<uint32_t> &result,
+                   const framebuffer_view<T> &view, const Source &source,
+                   size_t scale) const {
+        const size_t out_width = view.width / scale;
+        const size_t out_height = view.height / scale;
+        const uint32_t n = scale * scale;
+        result.resize(out_width * out_height);
+        std::vector<uint32_t> sums(3 * out_width);
+        for (size_t y = 0; y < out_height; y++) {
+            std::fill(sums.begin(), sums.end(), 0);
+            for (size_t sy = 0; sy < scale; sy++) {
+                const T *p = view.row(y * scale + sy);
+                uint32_t *sum = sums.data();
+                for (size_t x = 0; x < out_width; x++, sum += 3) {
+                    const auto &lut = tables[tile(x, y)];
+                    for (size_t sx = 0; sx < scale; sx++) {
+                        auto [r, g, b] = source(p);
+                        uint32_t v = lut.convert(r, g, b);
+                        sum[0] += v >> 20;
+                        sum[1] += (v >> 10) & 0x3ff;
+                        sum[2] += v & 0x3ff;
+                        p = view.next(p);
+                    }
+                }
+            }
+            uint32_t *out = result.data() + y * out_width;
+            const uint32_t *sum = sums.data();
+            for (size_t x = 0; x < out_width; x++, sum += 3) {
+                out[x] = ((sum[0] + n / 2) / n << 20) |
+                         ((sum[1] + n / 2) / n << 10) |
+                         ((sum[2] + n / 2) / n);
+            }
+        }
+    }
+
+    // Index of the tables for result pixel (x, y)
+    size_t tile(size_t x, size_t y) const {
+        if (single()) {
+            return 0;
+        }
+        return std::min(y / panel_height * panels_across + x / panel_width,
+                        n_tiles);
+    }
+
+    size_t width, panel_width, panel_height, panels_across = 0, n_tiles = 0;
+    std::vector<rgb888_lut> channels;
+    std::vector<matrix_lut> matrices;
+};
+
+// A table mapping every RGB565 value straight to rgb10 (256KiB)
+std::vector<uint32_t> make_rgb565_lut(const calibrated_lut &tables) {
+    std::vector<uint32_t> result(65536);
+    for (uint32_t data = 0; data < result.size(); data++) {
+        unsigned r5 = (data >> 11) & 0x1f;
+        unsigned r = (r5 << 3) | (r5 >> 2);
+        unsigned g6 = (data >> 5) & 0x3f;
+        unsigned g = (g6 << 2) | (g6 >> 4);
+        unsigned b5 = (data)&0x1f;
+        unsigned b = (b5 << 3) | (b5 >> 2);
+        result[data] = tables.convert(r, g, b);
+    }
+    return result;
+}
+
+// 16x16 blue noise threshold ranks, from the void-and-cluster method
+// clang-format off
+constexpr uint8_t blue_noise_16x16[] = {
+    243,  73, 179,  19,  45, 254, 185, 104, 214,  88, 121, 206, 100, 156,  22,  41,
+    216, 122, 199,  93, 154,  79,  25,  64, 244, 167,  58, 230,   9, 117, 173,  91,
+    152,  30,  55, 227, 128, 218, 197, 138,   8,  40, 186, 145,  76, 246, 207,  62,
+    188, 251, 112, 171,   5,  52, 106, 163, 232, 127, 103,  26, 192,  47, 133,   1,
+     77, 141,  23,  71, 237, 180,  33,  84, 208,  72, 200, 228,  89, 160, 107, 233,
+     94, 176, 220, 130,  95, 147, 250, 120,  21,  53, 153,  10, 174,  37, 203,  18,
+    151,  35,  54, 196,  17, 211,  63, 190, 168, 240, 132, 111, 255,  57, 124, 223,
+     65, 235, 118, 159,  83,  42, 137,   0, 101, 215,  31,  67, 209, 144,  82, 183,
+    109, 201,   4, 248, 178, 224, 110, 231,  49,  86, 161, 182,  97,   6, 238,  24,
+    172, 142,  78, 102,  27, 149,  69, 165, 193, 123,  14, 245,  43, 191, 155,  50,
+    241,  38, 221,  59, 129, 205,  13, 252,  34, 143, 222,  75, 135, 114, 219,  90,
+     16, 116, 189, 164, 236,  46, 119,  81, 213,  96,  60, 169, 204,  28,  61, 131,
+    212, 148,  85,  11, 195,  92, 181, 158,  20, 187, 234,   3,  87, 162, 253, 177,
+     36,  68, 247, 115,  32, 140, 242,  56, 113, 136,  44, 105, 217, 126,  12,  99,
+    166, 202,  51, 157, 210,  70,   2, 225, 198,  74, 249, 146, 184,  48,  80, 226,
+    108,   7, 134, 229,  98, 170, 125,  39, 150,  15, 175,  29,  66, 239, 194, 139,
+};
+// clang-format on
+
+// Ordered dithering of linear RGB10 data down to the number of bits that are
+// actually displayed (n_planes plus any temporal planes). A threshold which
+// depends on the pixel position is added to each channel before the low bits
+// are dropped, so that smooth gradients become fine patterns instead of
+// bands. The thresholds are expanded to whole rows when the geometry is set,
+// which leaves a branch-free add/min/mask per channel that vectorizes well.
+struct ordered_dither {
+    ordered_dither() {}
+    ordered_dither(const matrix_geometry &geometry) : width{geometry.width} {
+        int n_bits = geometry.n_planes + temporal_planes(geometry);
+        if (geometry.dither == no_dither || n_bits >= 10) {
+            return;
+        }
+        uint32_t step = 1u << (10 - n_bits);
+        mask = 0x3ff & ~(step - 1);
+        size = geometry.dither == bayer ? 8 : 16;
+        thresholds.resize(size * width);
+        for (size_t y = 0; y < size; y++) {
+            for (size_t x = 0; x < width; x++) {
+                uint32_t rank = geometry.dither == bayer
+                                    ? bayer_rank(x % size, y)
+                                    : blue_noise_16x16[y * 16 + x % 16];
+                // centered in the rank's interval, always less than a step
+                thresholds[y * width + x] =
+                    (2 * rank + 1) * step / (2 * size * size);
+            }
+        }
+    }
+
+    static uint32_t bayer_rank(size_t x, size_t y) {
+        uint32_t rank = 0;
+        for (size_t bit = 0; bit < 3; bit++) {
+            rank = (rank << 2) | ((((x ^ y) >> bit) & 1) << 1) |
+                   ((y >> bit) & 1);
+        }
+        return rank;
+    }
+
+    void apply(std::vector<uint32_t> &rgb10) const {
+        if (thresholds.empty()) {
+            return;
+        }
+        for (size_t i = 0, y = 0; i < rgb10.size(); i += width, y++) {
+            const uint16_t *row = &thresholds[(y % size) * width];
+            uint32_t *data = &rgb10[i];
+            size_t n = std::min(width, rgb10.size() - i);
+            for (size_t x = 0; x < n; x++) {
+                uint32_t t = row[x];
+                uint32_t r = std::min(((data[x] >> 20) & 0x3ff) + t, 1023u);
+                uint32_t g = std::min(((data[x] >> 10) & 0x3ff) + t, 1023u);
+                uint32_t b = std::min((data[x] & 0x3ff) + t, 1023u);
+                data[x] = ((r & mask) << 20) | ((g & mask) << 10) | (b & mask);
+            }
+        }
+    }
+
+    size_t width = 0;
+    uint32_t mask = 0x3ff;
+    size_t size = 0;
+    std::vector<uint16_t> thresholds;
+};
+
+// How many times larger than the framebuffer width `width` a source is; the
+// converters average blocks of that many pixels squared
+size_t source_scale(size_t width, size_t source_width) {
+    return width && source_width > width ? source_width / width : 1;
+}
+
 struct colorspace_rgb565 {
     using data_type = uint16_t;
     static constexpr size_t data_size_in_bytes(size_t n_pixels) {
         return sizeof(data_type) * n_pixels;
     }
 
-    colorspace_rgb565(float gamma = 2.2) : lut{gamma} {}
-    gamma_lut lut;
+    colorspace_rgb565(float gamma = 2.2) : tables{gamma, 0} {
+        direct = make_rgb565_lut(tables);
+    }
+    colorspace_rgb565(const matrix_geometry &geometry, float gamma = 2.2)
+        : tables{gamma, geometry.width}, dither{geometry},
+          width{geometry.width} {
+        direct = make_rgb565_lut(tables);
+    }
+
+    // With per-panel gains, the 16-bit pixels are split into channels and
+    // converted through the per-tile tables instead of the direct table
+    void set_calibration(const color_calibration &calibration) {
+        tables = calibrated_lut{calibration, width};
+        direct.clear();
+        if (tables.single()) {
+            direct = make_rgb565_lut(tables);
+        }
+    }
+
+    calibrated_lut tables;
+    std::vector<uint32_t> direct;
+    ordered_dither dither;
+    size_t width = 0;
     const std::span<const uint32_t>
     convert(std::span<const data_type> data_in) {
-        lut.convert_rgb565_to_rgb10(rgb10, data_in);
+        return convert(framebuffer_view<data_type>{data_in, width});
+    }
+    const std::span<const uint32_t>
+    convert(const framebuffer_view<data_type> &data_in) {
+        size_t scale = source_scale(width, data_in.width);
+        if (direct.size() && scale == 1) {
+            rgb10.resize(data_in.size());
+            uint32_t *out = rgb10.data();
+            for (size_t y = 0; y < data_in.height; y++) {
+                const data_type *p = data_in.row(y);
+                for (size_t x = 0; x < data_in.width; x++) {
+                    *out++ = direct[*p];
+                    p = data_in.next(p);
+                }
+            }
+        } else {
+            tables.convert(
+                rgb10, data_in,
+                [&](const data_type *p) {
+                    uint32_t data = *p;
+                    unsigned r5 = (data >> 11) & 0x1f;
+                    unsigned g6 = (data >> 5) & 0x3f;
+                    unsigned b5 = (data)&0x1f;
+                    return std::array<uint32_t, 3>{(r5 << 3) | (r5 >> 2),
+                                                   (g6 << 2) | (g6 >> 4),
+                                                   (b5 << 3) | (b5 >> 2)};
+                },
+                scale);
+        }
+        dither.apply(rgb10);
         return rgb10;
     }
     std::vector<uint32_t> rgb10;
@@ -93,11 +494,33 @@ struct colorspace_rgb888 {
         return sizeof(data_type) * n_pixels;
     }
 
-    colorspace_rgb888(float gamma = 2.2) : lut{gamma} {}
-    gamma_lut lut;
+    colorspace_rgb888(float gamma = 2.2) : tables{gamma, 0} {}
+    colorspace_rgb888(const matrix_geometry &geometry, float gamma = 2.2)
+        : tables{gamma, geometry.width}, dither{geometry},
+          width{geometry.width} {}
+
+    void set_calibration(const color_calibration &calibration) {
+        tables = calibrated_lut{calibration, width};
+    }
+
+    calibrated_lut tables;
+    ordered_dither dither;
+    size_t width = 0;
     const std::span<const uint32_t>
     convert(std::span<const data_type> data_in) {
-        lut.convert_rgb888_to_rgb10(rgb10, data_in);
+        return convert(framebuffer_view<data_type>{data_in, width});
+    }
+    const std::span<const uint32_t>
+    convert(const framebuffer_view<data_type> &data_in) {
+        tables.convert(
+            rgb10, data_in,
+            [&](const data_type *p) {
+                uint32_t data = *p;
+                return std::array<uint32_t, 3>{(data >> 16) & 0xff,
+                                               (data >> 8) & 0xff, data & 0xff};
+            },
+            source_scale(width, data_in.width));
+        dither.apply(rgb10);
         return rgb10;
     }
     std::vector<uint32_t> rgb10;
@@ -109,11 +532,31 @@ struct colorspace_rgb888_packed {
         return sizeof(data_type) * n_pixels * 3;
     }
 
-    colorspace_rgb888_packed(float gamma = 2.2) : lut{gamma} {}
-    gamma_lut lut;
+    colorspace_rgb888_packed(float gamma = 2.2) : tables{gamma, 0} {}
+    colorspace_rgb888_packed(const matrix_geometry &geometry, float gamma = 2.2)
+        : tables{gamma, geometry.width}, dither{geometry},
+          width{geometry.width} {}
+
+    void set_calibration(const color_calibration &calibration) {
+        tables = calibrated_lut{calibration, width};
+    }
+
+    calibrated_lut tables;
+    ordered_dither dither;
+    size_t width = 0;
     const std::span<const uint32_t>
     convert(std::span<const data_type> data_in) {
-        lut.convert_rgb888_packed_to_rgb10(rgb10, data_in);
+        return convert(framebuffer_view<data_type>{data_in, width, 3});
+    }
+    const std::span<const uint32_t>
+    convert(const framebuffer_view<data_type> &data_in) {
+        tables.convert(
+            rgb10, data_in,
+            [&](const data_type *p) {
+                return std::array<uint32_t, 3>{p[0], p[1], p[2]};
+            },
+            source_scale(width, data_in.width));
+        dither.apply(rgb10);
         return rgb10;
     }
     std::vector<uint32_t> rgb10;
@@ -121,30 +564,197 @@ struct colorspace_rgb888_packed {
 
 struct colorspace_rgb10 {
     using data_type = uint32_t;
+    static constexpr size_t data_size_in_bytes(size_t n_pixels) {
+        return sizeof(data_type) * n_pixels;
+    }
+
+    colorspace_rgb10() {}
+    colorspace_rgb10(const matrix_geometry &geometry) : dither{geometry} {}
 
+    void set_calibration(const color_calibration &) {
+        throw std::runtime_error("rgb10 data is not calibrated");
+    }
+
+    ordered_dither dither;
     const std::span<const uint32_t>
     convert(std::span<const data_type> data_in) {
-        return data_in;
+        if (dither.thresholds.empty()) {
+            return data_in;
+        }
+        rgb10.assign(data_in.begin(), data_in.end());
+        dither.apply(rgb10);
+        return rgb10;
+    }
+    const std::span<const uint32_t>
+    convert(const framebuffer_view<data_type> &data_in) {
+        if (data_in.contiguous()) {
+            return convert(std::span{data_in.data, data_in.size()});
+        }
+        rgb10.resize(data_in.size());
+        uint32_t *out = rgb10.data();
+        for (size_t y = 0; y < data_in.height; y++) {
+            const data_type *p = data_in.row(y);
+            for (size_t x = 0; x < data_in.width; x++, p = data_in.next(p)) {
+                *out++ = *p;
+            }
+        }
+        dither.apply(rgb10);
+        return rgb10;
     }
+    std::vector<uint32_t> rgb10;
 };
 
-// Render a buffer in linear RGB10 format into a piomatter stream
-template <typename pinout>
-void protomatter_render_rgb10(std::vector<uint32_t> &result,
-                              const matrix_geometry &matrixmap,
-                              const uint32_t *pixels) {
-    result.clear();
+// One bit plane of one address row, shown for `active_time` pixel times
+struct schedule_entry {
+    uint32_t addr;
+    uint32_t bit;
+    uint32_t active_time;
+};
+
+using schedule = std::vector<schedule_entry>;
+
+// Determine the order in which bit planes are shifted out and how long each
+// is shown. Without plane spreading, each row shows its planes MSB-first in
+// a single scan. With plane spreading, planes longer than
+// 2**(n_planes-1-plane_spread) are split into slices of that length, and the
+// slices are distributed over 2**plane_spread scans of all rows. The total
+// on-time of each plane is unchanged, but the longest /OE pulse is shorter
+// and light output is spread more evenly across the frame.
+//
+// Rows are visited in `addr_order`, or in order if it is empty.
+schedule make_schedule(size_t n_addr_lines, int n_planes, int plane_spread,
+                       const std::vector<size_t> &addr_order) {
+    const size_t n_addr = 1u << n_addr_lines;
+    plane_spread = std::clamp(plane_spread, 0, n_planes - 1);
+    const size_t n_scans = 1u << plane_spread;
+    const uint32_t max_active_time = 1u << (n_planes - 1 - plane_spread);
+
+    // longest slices first, each to the least loaded scan
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> scans(n_scans);
+    std::vector<uint32_t> load(n_scans);
+    for (int bit = n_planes - 1; bit >= 0; bit--) {
+        uint32_t active_time = std::min(1u << bit, max_active_time);
+        for (uint32_t i = 0; i < (1u << bit) / active_time; i++) {
+            auto scan = std::min_element(load.begin(), load.end()) -
+                        load.begin();
+            scans[scan].emplace_back(bit, active_time);
+            load[scan] += active_time;
+        }
+    }
+
+    std::vector<size_t> order = addr_order;
+    if (order.empty()) {
+        order = make_addr_order(linear, n_addr_lines);
+    }
+
+    // Alternate scans run backwards, so that the row at the end of one scan
+    // starts the next and doesn't pay for an extra address change
+    schedule result;
+    for (size_t scan = 0; scan < n_scans; scan++) {
+        for (size_t i = 0; i < n_addr; i++) {
+            size_t addr = order[scan % 2 ? n_addr - i - 1 : i];
+            for (const auto &[bit, active_time] : scans[scan]) {
+                result.push_back({uint32_t(addr), bit, active_time});
+            }
+        }
+    }
+    return result;
+}
+
+schedule make_schedule(const matrix_geometry &geometry) {
+    return make_schedule(geometry.n_addr_lines, geometry.n_planes,
+                         geometry.plane_spread, geometry.addr_order);
+}
+
+// Number of scans of all address rows made by one pass through a schedule
+size_t schedule_scans(const matrix_geometry &geometry) {
+    return size_t{1} << std::clamp(geometry.plane_spread, 0,
+                                   geometry.n_planes - 1);
+}
 
+// Number of PIO cycles taken to clock out a rendered stream
+uint64_t protomatter_stream_cycles(std::span<const uint32_t> stream) {
+    uint64_t cycles = 0;
+    for (size_t i = 0; i < stream.size();) {
+        uint32_t command = stream[i];
+        uint32_t count = (command & ~command_data) + 1;
+        if (command & command_data) {
+            cycles += DATA_OVERHEAD + CLOCKS_PER_DATA * count;
+            i += count + 1;
+        } else {
+            cycles += DELAY_OVERHEAD + CLOCKS_PER_DELAY * count;
+            i += 2;
+        }
+    }
+    return cycles;
+}
+
+// Number of delay loop iterations used for a delay of `delay` PIO cycles
+int32_t delay_count(int32_t delay) {
+    return std::max((delay / CLOCKS_PER_DELAY) - DELAY_OVERHEAD, 1);
+}
+
+// How a latched plane's on-time is emitted while the next plane is shifted
+// in. /OE is active for the first `active_words` data words, then for
+// `active_delay` delay loops if `delay_active`. When dimmed, the on-time
+// removed from the delay is added to the following /OE inactive delay as
+// `extra_off`, so the stream timing doesn't depend on the brightness.
+struct oe_timing {
+    int32_t active_words;
+    bool delay_active;
+    int32_t active_delay;
+    int32_t extra_off;
+};
+
+oe_timing make_oe_timing(int32_t active_time, double brightness,
+                         size_t pixels_across) {
+    const int32_t across = pixels_across;
+    int32_t on_time = std::lround(active_time * std::clamp(brightness, 0., 1.));
+    int32_t full_delay = delay_count((active_time - across) * CLOCKS_PER_DATA /
+                                         CLOCKS_PER_DELAY -
+                                     DELAY_OVERHEAD);
+    if (on_time <= across) {
+        // the on-time runs out while shifting; don't extend it by the
+        // minimum delay
+        return {on_time, false, full_delay, 0};
+    }
+    int32_t on_delay = delay_count((on_time - across) * CLOCKS_PER_DATA /
+                                       CLOCKS_PER_DELAY -
+                                   DELAY_OVERHEAD);
+    return {across, true, on_delay, full_delay - on_delay};
+}
+
+// Brightness of the plane latched for row `addr`
+double row_brightness(const matrix_geometry &geometry, size_t addr) {
+    double result = geometry.brightness;
+    if (addr < geometry.row_brightness.size()) {
+        result *= geometry.row_brightness[addr];
+    }
+    return result;
+}
+
+// Append one refresh of a buffer in linear RGB10 format to a piomatter
+// stream
+template <typename pinout>
+void protomatter_render_schedule(std::vector<uint32_t> &result,
+                                 const matrix_geometry &matrixmap,
+                                 const compiled_map &map,
+                                 const schedule &entries,
+                                 const uint32_t *pixels) {
     int data_count = 0;
 
-    auto do_data_delay = [&](uint32_t data, int32_t delay) {
-        delay = std::max((delay / CLOCKS_PER_DELAY) - DELAY_OVERHEAD, 1);
-        assert(delay < 1000000);
+    auto do_data_count = [&](uint32_t data, int32_t count) {
+        assert(count >= 1);
+        assert(count < 1000000);
         assert(!data_count);
-        result.push_back(command_delay | (delay ? delay - 1 : 0));
+        result.push_back(command_delay | (count - 1));
         result.push_back(data);
     };
 
+    auto do_data_delay = [&](uint32_t data, int32_t delay) {
+        do_data_count(data, delay_count(delay));
+    };
+
     auto prep_data = [&data_count, &result](uint32_t n) {
         assert(!data_count);
         assert(n);
@@ -203,65 +813,218 @@ void protomatter_render_rgb10(std::vector<uint32_t> &result,
         do_data_clk_active(data);
     };
 
-    int last_bit = 0;
     // illuminate the right row for data in the shift register (the previous
     // address)
 
-    const size_t n_addr = 1u << matrixmap.n_addr_lines;
     const int n_planes = matrixmap.n_planes;
     constexpr size_t n_bits = 10u;
     unsigned offset = n_bits - n_planes;
     const size_t pixels_across = matrixmap.pixels_across;
 
-    size_t prev_addr = n_addr - 1;
+    // the stream repeats, so it begins by showing its own final entry
+    size_t prev_addr = entries.back().addr;
     uint32_t addr_bits = calc_addr_bits(prev_addr);
+    int32_t last_active_time = entries.back().active_time;
+    double brightness = row_brightness(matrixmap, prev_addr);
 
-    for (size_t addr = 0; addr < n_addr; addr++) {
-        // printf("addr=%zu/%zu\n", addr, n_addr);
-        for (int bit = n_planes - 1; bit >= 0; bit--) {
-            // printf("bit=%d/%d\n", bit, n_planes);
-            uint32_t r = 1 << (20 + offset + bit);
-            uint32_t g = 1 << (10 + offset + bit);
-            uint32_t b = 1 << (0 + offset + bit);
-
-            // the shortest /OE we can do is one DATA_OVERHEAD...
-            // TODO: should make sure desired duration of MSB is at least
-            // `pixels_across`
-            active_time = 1 << last_bit;
-            last_bit = bit;
-
-            prep_data(pixels_across);
-            auto mapiter = matrixmap.map.begin() + 2 * addr * pixels_across;
-            for (size_t x = 0; x < pixels_across; x++) {
-                assert(mapiter != matrixmap.map.end());
-                auto pixel0 = pixels[*mapiter++];
+    for (const auto &entry : entries) {
+        // printf("addr=%u bit=%u\n", entry.addr, entry.bit);
+        uint32_t r = 1 << (20 + offset + entry.bit);
+        uint32_t g = 1 << (10 + offset + entry.bit);
+        uint32_t b = 1 << (0 + offset + entry.bit);
+
+        // the shortest /OE we can do is one DATA_OVERHEAD...
+        // TODO: should make sure desired duration of MSB is at least
+        // `pixels_across`
+        auto timing =
+            make_oe_timing(last_active_time, brightness, pixels_across);
+        active_time = timing.active_words;
+        last_active_time = entry.active_time;
+        brightness = row_brightness(matrixmap, entry.addr);
+
+        prep_data(pixels_across);
+        map.for_each_pair(
+            entry.addr, pixels_across, pixels,
+            [&](uint32_t pixel0, uint32_t pixel1) {
                 auto r0 = pixel0 & r;
                 auto g0 = pixel0 & g;
                 auto b0 = pixel0 & b;
-                assert(mapiter != matrixmap.map.end());
-                auto pixel1 = pixels[*mapiter++];
                 auto r1 = pixel1 & r;
                 auto g1 = pixel1 & g;
                 auto b1 = pixel1 & b;
 
                 add_pixels(addr_bits, r0, g0, b0, r1, g1, b1);
-            }
+            });
 
-            do_data_delay(addr_bits | pinout::oe_active,
-                          active_time * CLOCKS_PER_DATA / CLOCKS_PER_DELAY -
-                              DELAY_OVERHEAD);
+        do_data_count(addr_bits | (timing.delay_active ? pinout::oe_active
+                                                       : pinout::oe_inactive),
+                      timing.active_delay);
 
+        do_data_count(addr_bits | pinout::oe_inactive,
+                      delay_count(pinout::post_oe_delay) + timing.extra_off);
+        do_data_delay(addr_bits | pinout::oe_inactive | pinout::lat_bit,
+                      pinout::post_latch_delay);
+
+        // with oe inactive, set address bits to illuminate THIS line
+        if (entry.addr != prev_addr) {
+            addr_bits = calc_addr_bits(entry.addr);
             do_data_delay(addr_bits | pinout::oe_inactive,
-                          pinout::post_oe_delay);
-            do_data_delay(addr_bits | pinout::oe_inactive | pinout::lat_bit,
-                          pinout::post_latch_delay);
-
-            // with oe inactive, set address bits to illuminate THIS line
-            if (addr != prev_addr) {
-                addr_bits = calc_addr_bits(addr);
-                do_data_delay(addr_bits | pinout::oe_inactive,
-                              pinout::post_addr_delay);
-                prev_addr = addr;
+                          pinout::post_addr_delay);
+            prev_addr = entry.addr;
+        }
+    }
+}
+
+// Gather the pixels into the order of `compiled_map::make_scan_order_map`.
+// This is done in tiles of address rows by columns: for a rotated map,
+// neighbouring columns are a whole framebuffer row apart but neighbouring
+// address rows are adjacent, so each tile reads a few cache lines from each
+// of a few rows.
+void transpose_to_scan_order(std::vector<uint32_t> &result,
+                             const matrix_geometry &matrixmap,
+                             const uint32_t *pixels) {
+    constexpr size_t tile = 16;
+    const size_t pixels_across = matrixmap.pixels_across;
+    const size_t n_addr = 1u << matrixmap.n_addr_lines;
+    const int *map = matrixmap.map.data();
+    result.resize(2 * n_addr * pixels_across);
+    for (size_t a0 = 0; a0 < n_addr; a0 += tile) {
+        size_t a1 = std::min(a0 + tile, n_addr);
+        for (size_t x0 = 0; x0 < pixels_across; x0 += tile) {
+            size_t x1 = std::min(x0 + tile, pixels_across);
+            for (size_t addr = a0; addr < a1; addr++) {
+                const int *row = map + 2 * addr * pixels_across;
+                uint32_t *out0 = result.data() + 2 * addr * pixels_across;
+                uint32_t *out1 = out0 + pixels_across;
+                for (size_t x = x0; x < x1; x++) {
+                    out0[x] = pixels[row[2 * x]];
+                    out1[x] = pixels[row[2 * x + 1]];
+                }
+            }
+        }
+    }
+}
+
+// Render a buffer in linear RGB10 format into a piomatter stream.
+//
+// With temporal dithering the stream holds one refresh per combination of
+// the temporal planes. Each refresh adds a different threshold to the bits
+// that are not displayed before they are dropped, so that averaged over the
+// whole stream the pixel is shown with the extra bits of depth.
+template <typename pinout>
+void protomatter_render_rgb10(std::vector<uint32_t> &result,
+                              const matrix_geometry &matrixmap,
+                              const uint32_t *pixels) {
+    result.clear();
+
+    const auto entries = make_schedule(matrixmap);
+    const int n_temporal_planes = temporal_planes(matrixmap);
+    const compiled_map *map = &matrixmap.compiled;
+    std::vector<uint32_t> transposed;
+    // temporal dithering works on a copy of just the displayed pixels, which
+    // might be part of a larger canvas
+    if (!map->sequential || n_temporal_planes) {
+        transpose_to_scan_order(transposed, matrixmap, pixels);
+        pixels = transposed.data();
+        map = &matrixmap.scan_map;
+    }
+
+    if (!n_temporal_planes) {
+        protomatter_render_schedule<pinout>(result, matrixmap, *map, entries,
+                                            pixels);
+        return;
+    }
+
+    const size_t n_pixels = transposed.size();
+    const unsigned shift = 10 - matrixmap.n_planes - n_temporal_planes;
+    std::vector<uint32_t> dithered(n_pixels);
+    for (size_t i = 0; i < (1u << n_temporal_planes); i++) {
+        // bit reversed, so that successive refreshes alternate thresholds
+        uint32_t threshold = reverse_bits(i, n_temporal_planes) << shift;
+        for (size_t j = 0; j < n_pixels; j++) {
+            uint32_t data = pixels[j];
+            uint32_t r = std::min(((data >> 20) & 0x3ff) + threshold, 1023u);
+            uint32_t g = std::min(((data >> 10) & 0x3ff) + threshold, 1023u);
+            uint32_t b = std::min((data & 0x3ff) + threshold, 1023u);
+            dithered[j] = (r << 20) | (g << 10) | b;
+        }
+        protomatter_render_schedule<pinout>(result, matrixmap, *map, entries,
+                                            dithered.data());
+    }
+}
+
+// The number of words protomatter_render_rgb10() produces for a schedule:
+// each entry is a data block and three delays, each a command word and a
+// data word, plus one more delay when the address changes; with temporal
+// dithering, the schedule is repeated for each refresh.
+size_t protomatter_stream_size(const schedule &entries, size_t pixels_across,
+                               int n_temporal_planes) {
+    size_t prev_addr = entries.back().addr;
+    size_t size = 0;
+    for (const auto &entry : entries) {
+        size += 1 + pixels_across + 6;
+        if (entry.addr != prev_addr) {
+            size += 2;
+            prev_addr = entry.addr;
+        }
+    }
+    return size << n_temporal_planes;
+}
+
+size_t protomatter_stream_size(const matrix_geometry &matrixmap) {
+    return protomatter_stream_size(make_schedule(matrixmap),
+                                   matrixmap.pixels_across,
+                                   temporal_planes(matrixmap));
+}
+
+// Update the /OE timing of a rendered stream for a new brightness, without
+// rendering it again. This relies on the layout of the stream not depending
+// on the brightness: each schedule entry is a data block followed by three
+// delays, plus one more when the address changes.
+template <typename pinout>
+void protomatter_update_brightness(std::span<uint32_t> stream,
+                                   const matrix_geometry &matrixmap) {
+    if (stream.size() != protomatter_stream_size(matrixmap)) {
+        throw std::runtime_error("stream does not match the geometry");
+    }
+    const auto entries = make_schedule(matrixmap);
+    const size_t pixels_across = matrixmap.pixels_across;
+
+    size_t i = 0;
+    while (i < stream.size()) {
+        size_t prev_addr = entries.back().addr;
+        int32_t last_active_time = entries.back().active_time;
+        for (const auto &entry : entries) {
+            auto timing =
+                make_oe_timing(last_active_time,
+                               row_brightness(matrixmap, prev_addr),
+                               pixels_across);
+            last_active_time = entry.active_time;
+
+            if (stream[i] != (command_data | (pixels_across - 1))) {
+                throw std::runtime_error("stream does not match the geometry");
+            }
+            i++;
+            for (size_t x = 0; x < pixels_across; x++, i++) {
+                stream[i] = (stream[i] & ~pinout::oe_bit) |
+                            (int32_t(x) < timing.active_words
+                                 ? pinout::oe_active
+                                 : pinout::oe_inactive);
+            }
+
+            stream[i++] = command_delay | (timing.active_delay - 1);
+            stream[i] = (stream[i] & ~pinout::oe_bit) |
+                        (timing.delay_active ? pinout::oe_active
+                                             : pinout::oe_inactive);
+            i++;
+            stream[i] = command_delay |
+                        (delay_count(pinout::post_oe_delay) +
+                         timing.extra_off - 1);
+            i += 4; // post-oe data word and latch delay
+
+            if (entry.addr != prev_addr) {
+                i += 2;
+                prev_addr = entry.addr;
             }
         }
     }
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "piomatter.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace piomatter {
+
+// Move the viewport across the canvas at `dx`, `dy` pixels per second from a
+// thread of its own, showing every one-pixel step. There are `range_x` by
+// `range_y` viewport positions; past the last one the viewport wraps around
+// to the first. If showing a position fails, scrolling stops and error()
+// says why.
+struct viewport_scroller {
+    viewport_scroller(piomatter_base &matter, size_t range_x, size_t range_y,
+                      size_t x, size_t y, double dx, double dy)
+        : x{x}, y{y}, matter{matter}, range_x{double(range_x)},
+          range_y{double(range_y)}, dx{dx}, dy{dy} {
+        double speed = std::max(std::abs(dx), std::abs(dy));
+        if (!(speed > 0) || !range_x || !range_y) {
+            throw std::range_error("scrolling needs a speed and a canvas");
+        }
+        auto period = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::duration<double>(1 / speed));
+        scroll_thread = std::thread{&viewport_scroller::scroll, this, period};
+    }
+
+    viewport_scroller(const viewport_scroller &) = delete;
+    viewport_scroller &operator=(const viewport_scroller &) = delete;
+
+    ~viewport_scroller() {
+        exit_request = true;
+        scroll_thread.join();
+    }
+
+    // Why scrolling stopped early, if it did
+    std::string error() {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        return error_message;
+    }
+
+    // the viewport position last shown
+    std::atomic<size_t> x, y;
+
+  private:
+    static double wrap(double v, double range) {
+        v = std::fmod(v, range);
+        return v < 0 ? v + range : v;
+    }
+
+    void scroll(std::chrono::nanoseconds period) {
+        double step = std::chrono::duration<double>(period).count();
+        double fx = x, fy = y;
+        auto next = std::chrono::steady_clock::now();
+        while (!exit_request) {
+            next = std::max(next + period, std::chrono::steady_clock::now());
+            std::this_thread::sleep_until(next);
+            fx = wrap(fx + dx * step, range_x);
+            fy = wrap(fy + dy * step, range_y);
+            x = size_t(fx);
+            y = size_t(fy);
+            try {
+                matter.show_viewport(x, y);
+            } catch (const std::exception &e) {
+                // the canvas was replaced by one that doesn't fit
+                std::lock_guard<std::mutex> lock(error_mutex);
+                error_message = e.what();
+                return;
+            }
+        }
+    }
+
+    piomatter_base &matter;
+    double range_x, range_y, dx, dy;
+    std::mutex error_mutex;
+    std::string error_message;
+    std::atomic<bool> exit_request{false};
+    std::thread scroll_thread;
+};
+
+} // namespace piomatter
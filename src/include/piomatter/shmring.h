@@ -0,0 +1,282 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <functional>
+#include <linux/futex.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+#include "piomatter/framebuffer.h"
+
+namespace piomatter {
+
+// A ring of framebuffers in POSIX shared memory, written by a producer in
+// another process and shown by the driver. The shared memory object starts
+// with a shm_ring_header; slot i is at data_offset + i * slot_size, and holds
+// a frame of height rows of width pixels of pixel_size bytes, without
+// padding: 2 bytes for RGB565, 3 for packed RGB888 and 4 for RGB888.
+//
+// The producer writes frame number write_sequence + 1 (starting from 1) into
+// slot (write_sequence + 1) % n_slots, but only once that is less than
+// read_sequence + n_slots. It then stores the new write_sequence, increments
+// `doorbell` and wakes it with FUTEX_WAKE. The driver waits on `doorbell`,
+// claims the newest frame by storing it in read_sequence, shows it straight
+// from its slot, then increments `consumed` and wakes that, for producers
+// waiting for a slot. Frames that are overtaken before the driver gets to
+// them are skipped. The futexes are process-shared, so not FUTEX_PRIVATE.
+constexpr char shm_ring_magic[8] = {'P', 'I', 'O', 'M', 'R', 'I', 'N', 'G'};
+constexpr uint32_t shm_ring_version = 1;
+
+struct shm_ring_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_slots;
+    uint32_t width, height, pixel_size;
+    uint32_t data_offset;
+    uint64_t slot_size;
+    alignas(64) std::atomic<uint64_t> write_sequence;
+    std::atomic<uint32_t> doorbell;
+    alignas(64) std::atomic<uint64_t> read_sequence;
+    std::atomic<uint32_t> consumed;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+              std::atomic<uint32_t>::is_always_lock_free);
+
+// Wait until *word is no longer `value`, for at most `timeout`; spurious
+// wakeups are possible
+void futex_wait(std::atomic<uint32_t> &word, uint32_t value,
+                std::chrono::nanoseconds timeout) {
+    timespec ts{time_t(timeout.count() / 1000000000),
+                long(timeout.count() % 1000000000)};
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, value,
+            &ts, nullptr, 0);
+}
+
+void futex_wake_all(std::atomic<uint32_t> &word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE,
+            INT_MAX, nullptr, nullptr, 0);
+}
+
+// A shared memory ring mapped into this process
+struct shm_ring_mapping {
+    shm_ring_mapping() = default;
+    shm_ring_mapping(const shm_ring_mapping &) = delete;
+    shm_ring_mapping &operator=(const shm_ring_mapping &) = delete;
+    ~shm_ring_mapping() {
+        if (mapped) {
+            munmap(mapped, mapped_size);
+        }
+    }
+
+    shm_ring_header &header() const {
+        return *reinterpret_cast<shm_ring_header *>(mapped);
+    }
+
+    uint8_t *slot(uint64_t sequence) const {
+        return mapped + data_offset + sequence % n_slots * slot_size;
+    }
+
+    framebuffer_view<uint8_t> view(uint64_t sequence) const {
+        return {slot(sequence), width, height, ptrdiff_t(width * pixel_size),
+                ptrdiff_t(pixel_size)};
+    }
+
+    // The layout of the ring, kept here rather than read from the header
+    // each time, since the other process can write to the header
+    size_t n_slots = 0, width = 0, height = 0, pixel_size = 0;
+    size_t data_offset = 0, slot_size = 0;
+
+  protected:
+    [[noreturn]] static void throw_errno(const std::string &what) {
+        throw std::runtime_error(what + ": " + strerror(errno));
+    }
+
+    void map(int fd, size_t size, const std::string &name) {
+        void *p =
+            mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            int saved_errno = errno;
+            close(fd);
+            errno = saved_errno;
+            throw_errno("mmap " + name);
+        }
+        close(fd);
+        mapped = static_cast<uint8_t *>(p);
+        mapped_size = size;
+    }
+
+    uint8_t *mapped = nullptr;
+    size_t mapped_size = 0;
+};
+
+// The driver's end: creates the ring, and shows each new frame from a thread
+// of its own through `show`, which is given a view of the frame's slot
+struct shm_ring_consumer : shm_ring_mapping {
+    using show_function =
+        std::function<void(const framebuffer_view<uint8_t> &)>;
+
+    shm_ring_consumer(const std::string &name, size_t width, size_t height,
+                      size_t pixel_size, size_t n_slots, show_function show)
+        : name{name}, show{std::move(show)} {
+        this->n_slots = n_slots;
+        this->width = width;
+        this->height = height;
+        this->pixel_size = pixel_size;
+        if (n_slots < 2) {
+            throw std::range_error("a frame ring needs at least 2 slots");
+        }
+        // replace any ring left behind by a driver that didn't exit cleanly
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                          0660);
+        if (fd < 0) {
+            throw_errno("shm_open " + name);
+        }
+        slot_size = width * height * pixel_size;
+        data_offset = 4096;
+        size_t size = data_offset + n_slots * slot_size;
+        if (ftruncate(fd, size) < 0) {
+            int saved_errno = errno;
+            close(fd);
+            shm_unlink(name.c_str());
+            errno = saved_errno;
+            throw_errno("ftruncate " + name);
+        }
+        try {
+            map(fd, size, name);
+        } catch (...) {
+            shm_unlink(name.c_str());
+            throw;
+        }
+
+        auto &h = header();
+        h.version = shm_ring_version;
+        h.n_slots = n_slots;
+        h.width = width;
+        h.height = height;
+        h.pixel_size = pixel_size;
+        h.data_offset = data_offset;
+        h.slot_size = slot_size;
+        // producers check the magic last
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(h.magic, shm_ring_magic, sizeof(h.magic));
+
+        consumer_thread = std::thread{&shm_ring_consumer::consume, this};
+    }
+
+    ~shm_ring_consumer() {
+        exit_request = true;
+        consumer_thread.join();
+        shm_unlink(name.c_str());
+    }
+
+    // frames shown, and frames overtaken by newer ones before being shown
+    std::atomic<uint64_t> frames{0}, frames_skipped{0};
+
+  private:
+    // Only write_sequence and doorbell come from the producer; a sequence
+    // that goes backwards is ignored until it passes the last frame shown
+    void consume() {
+        auto &h = header();
+        uint64_t shown = 0;
+        while (!exit_request) {
+            uint32_t bell = h.doorbell.load(std::memory_order_acquire);
+            uint64_t sequence =
+                h.write_sequence.load(std::memory_order_acquire);
+            if (sequence <= shown) {
+                // wake up now and then to check for exit requests
+                futex_wait(h.doorbell, bell, std::chrono::milliseconds(100));
+                continue;
+            }
+            h.read_sequence.store(sequence, std::memory_order_release);
+            try {
+                show(view(sequence));
+            } catch (const std::exception &) {
+                // dropped, like a frame that's overtaken
+            }
+            frames_skipped += sequence - shown - 1;
+            frames++;
+            shown = sequence;
+            h.consumed.fetch_add(1, std::memory_order_release);
+            futex_wake_all(h.consumed);
+        }
+    }
+
+    std::string name;
+    show_function show;
+    std::atomic<bool> exit_request{false};
+    std::thread consumer_thread;
+};
+
+// A producer's end, for C++ producers; producers in other languages follow
+// the protocol described with shm_ring_header. There may be only one
+// producer at a time.
+struct shm_ring_producer : shm_ring_mapping {
+    explicit shm_ring_producer(const std::string &name) {
+        int fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+        if (fd < 0) {
+            throw_errno("shm_open " + name);
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0 ||
+            size_t(st.st_size) < sizeof(shm_ring_header)) {
+            close(fd);
+            throw std::runtime_error(name + " is not a frame ring");
+        }
+        map(fd, st.st_size, name);
+        const auto &h = header();
+        if (memcmp(h.magic, shm_ring_magic, sizeof(h.magic)) ||
+            h.version != shm_ring_version || h.n_slots < 2 ||
+            h.slot_size != uint64_t(h.width) * h.height * h.pixel_size ||
+            h.data_offset + h.n_slots * h.slot_size > mapped_size) {
+            throw std::runtime_error(name + " is not a frame ring");
+        }
+        n_slots = h.n_slots;
+        width = h.width;
+        height = h.height;
+        pixel_size = h.pixel_size;
+        data_offset = h.data_offset;
+        slot_size = h.slot_size;
+    }
+
+    // The slot for the next frame, once the driver is done with it, or
+    // nullptr if that takes longer than `timeout`
+    uint8_t *next_frame(std::chrono::nanoseconds timeout) {
+        auto &h = header();
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        uint64_t next = h.write_sequence.load(std::memory_order_relaxed) + 1;
+        while (true) {
+            uint32_t consumed = h.consumed.load(std::memory_order_acquire);
+            if (next - h.read_sequence.load(std::memory_order_acquire) <
+                n_slots) {
+                return slot(next);
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline) {
+                return nullptr;
+            }
+            futex_wait(h.consumed, consumed, deadline - now);
+        }
+    }
+
+    // Make the frame written to the slot from next_frame() the newest
+    void publish() {
+        auto &h = header();
+        h.write_sequence.fetch_add(1, std::memory_order_release);
+        h.doorbell.fetch_add(1, std::memory_order_release);
+        futex_wake_all(h.doorbell);
+    }
+};
+
+} // namespace piomatter
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <span>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "piomatter/framebuffer.h"
+#include "piomatter/matrixmap.h"
+#include "piomatter/pins.h"
+#include "piomatter/render.h"
+
+namespace piomatter {
+
+// A stream file holds rendered PIO streams, so that they can be played
+// without converting or rendering anything. It is a stream_file_header, a
+// table of n_frames stream_file_frame entries, and then the streams
+// themselves. Everything is in the byte order of the machine that wrote it.
+//
+// The header records everything the streams depend on: the pins and delays of
+// the pinout, and the parts of the geometry that shape the schedule. The
+// streams are rendered at full brightness.
+constexpr char stream_file_magic[8] = {'P', 'I', 'O', 'M', 'S', 'T', 'R', 'M'};
+constexpr uint32_t stream_file_version = 1;
+
+struct stream_file_pinout {
+    uint8_t rgb[6], addr[5], oe, clk, lat;
+    uint32_t post_oe_delay, post_latch_delay, post_addr_delay;
+
+    template <typename pinout> static stream_file_pinout of() {
+        stream_file_pinout result{};
+        std::copy(std::begin(pinout::PIN_RGB), std::end(pinout::PIN_RGB),
+                  result.rgb);
+        std::copy(std::begin(pinout::PIN_ADDR), std::end(pinout::PIN_ADDR),
+                  result.addr);
+        result.oe = pinout::PIN_OE;
+        result.clk = pinout::PIN_CLK;
+        result.lat = pinout::PIN_LAT;
+        result.post_oe_delay = pinout::post_oe_delay;
+        result.post_latch_delay = pinout::post_latch_delay;
+        result.post_addr_delay = pinout::post_addr_delay;
+        return result;
+    }
+
+    bool operator==(const stream_file_pinout &) const = default;
+};
+
+struct stream_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_frames;
+    stream_file_pinout pinout;
+    uint32_t width, height, pixels_across, n_addr_lines;
+    int32_t n_planes, n_temporal_planes, plane_spread;
+    uint8_t addr_order[32];
+
+    static stream_file_header of(const stream_file_pinout &pinout,
+                                 const matrix_geometry &geometry) {
+        stream_file_header result{};
+        std::copy(std::begin(stream_file_magic), std::end(stream_file_magic),
+                  result.magic);
+        result.version = stream_file_version;
+        result.pinout = pinout;
+        result.width = geometry.width;
+        result.height = geometry.height;
+        result.pixels_across = geometry.pixels_across;
+        result.n_addr_lines = geometry.n_addr_lines;
+        result.n_planes = geometry.n_planes;
+        result.n_temporal_planes = temporal_planes(geometry);
+        result.plane_spread =
+            std::clamp(geometry.plane_spread, 0, geometry.n_planes - 1);
+        auto order = geometry.addr_order;
+        if (order.empty()) {
+            order = make_addr_order(linear, geometry.n_addr_lines);
+        }
+        if (order.size() > std::size(result.addr_order)) {
+            throw std::range_error("too many address lines for a stream file");
+        }
+        std::copy(order.begin(), order.end(), result.addr_order);
+        return result;
+    }
+
+    // Whether streams described by this header can be played where `other`
+    // could, including having their brightness changed
+    bool matches(const stream_file_header &other) const {
+        return pinout == other.pinout &&
+               pixels_across == other.pixels_across &&
+               n_addr_lines == other.n_addr_lines &&
+               n_planes == other.n_planes &&
+               n_temporal_planes == other.n_temporal_planes &&
+               plane_spread == other.plane_spread &&
+               !memcmp(addr_order, other.addr_order, sizeof(addr_order));
+    }
+};
+
+struct stream_file_frame {
+    uint64_t offset; // from the start of the file, in bytes
+    uint64_t size;   // in 32-bit words
+    uint64_t duration; // in ns
+};
+
+[[noreturn]] void throw_file_errno(const std::string &what) {
+    throw std::runtime_error(what + ": " + strerror(errno));
+}
+
+// Render frames to a stream file, without any hardware. The frames are
+// converted with the colorspace's default gamma and no calibration.
+template <typename pinout, typename colorspace>
+void write_stream_file(
+    const std::string &path, const matrix_geometry &geometry,
+    const std::vector<framebuffer_view<typename colorspace::data_type>> &frames,
+    const std::vector<double> &durations) {
+    if (frames.empty() || frames.size() != durations.size()) {
+        throw std::runtime_error(
+            "an animation needs one duration for each of its frames");
+    }
+    auto header =
+        stream_file_header::of(stream_file_pinout::of<pinout>(), geometry);
+    header.n_frames = frames.size();
+    std::vector<stream_file_frame> table(frames.size());
+
+    std::unique_ptr<FILE, decltype(&fclose)> f{fopen(path.c_str(), "wb"),
+                                               &fclose};
+    if (!f) {
+        throw_file_errno("open " + path);
+    }
+    auto write = [&](const void *data, size_t size) {
+        if (fwrite(data, 1, size, f.get()) != size) {
+            throw_file_errno("write " + path);
+        }
+    };
+
+    matrix_geometry full_brightness = geometry;
+    full_brightness.brightness = 1;
+    full_brightness.row_brightness.clear();
+    colorspace converter{geometry};
+    std::vector<uint32_t> stream;
+
+    uint64_t offset = sizeof(header) + table.size() * sizeof(table[0]);
+    if (fseek(f.get(), offset, SEEK_SET)) {
+        throw_file_errno("seek " + path);
+    }
+    for (size_t i = 0; i < frames.size(); i++) {
+        if (!(durations[i] > 0)) {
+            throw std::range_error("frame durations must be positive");
+        }
+        auto converted = converter.convert(frames[i]);
+        protomatter_render_rgb10<pinout>(stream, full_brightness,
+                                         converted.data());
+        write(stream.data(), stream.size() * sizeof(stream[0]));
+        table[i] = {offset, stream.size(), uint64_t(durations[i] * 1e9)};
+        offset += stream.size() * sizeof(stream[0]);
+    }
+
+    rewind(f.get());
+    write(&header, sizeof(header));
+    write(table.data(), table.size() * sizeof(table[0]));
+    if (fflush(f.get())) {
+        throw_file_errno("write " + path);
+    }
+}
+
+// A stream file mapped into memory. The mapping is private, so that the
+// streams' brightness can be changed in place without touching the file.
+struct stream_file {
+    explicit stream_file(const std::string &path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw_file_errno("open " + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            close(fd);
+            throw_file_errno("stat " + path);
+        }
+        mapped_size = st.st_size;
+        void *p = mapped_size >= sizeof(stream_file_header)
+                      ? mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE, fd, 0)
+                      : MAP_FAILED;
+        int saved_errno = errno;
+        close(fd);
+        if (mapped_size < sizeof(stream_file_header)) {
+            throw std::runtime_error(path + " is not a stream file");
+        }
+        if (p == MAP_FAILED) {
+            errno = saved_errno;
+            throw_file_errno("mmap " + path);
+        }
+        mapped = static_cast<uint8_t *>(p);
+        try {
+            validate(path);
+        } catch (...) {
+            munmap(mapped, mapped_size);
+            throw;
+        }
+    }
+
+    stream_file(const stream_file &) = delete;
+    stream_file &operator=(const stream_file &) = delete;
+
+    ~stream_file() { munmap(mapped, mapped_size); }
+
+    const stream_file_header &header() const {
+        return *reinterpret_cast<const stream_file_header *>(mapped);
+    }
+
+    size_t size() const { return header().n_frames; }
+
+    std::span<uint32_t> stream(size_t i) const {
+        const auto &entry = frame(i);
+        return {reinterpret_cast<uint32_t *>(mapped + entry.offset),
+                size_t(entry.size)};
+    }
+
+    uint64_t duration(size_t i) const { return frame(i).duration; }
+
+  private:
+    const stream_file_frame &frame(size_t i) const {
+        return reinterpret_cast<const stream_file_frame *>(
+            mapped + sizeof(stream_file_header))[i];
+    }
+
+    void validate(const std::string &path) const {
+        const auto &h = header();
+        if (memcmp(h.magic, stream_file_magic, sizeof(h.magic))) {
+            throw std::runtime_error(path + " is not a stream file");
+        }
+        if (h.version != stream_file_version) {
+            throw std::runtime_error(path + " has unsupported version " +
+                                     std::to_string(h.version));
+        }
+        if (!h.n_frames || (mapped_size - sizeof(h)) / sizeof(frame(0)) <
+                               h.n_frames) {
+            throw std::runtime_error(path + " has a bad frame table");
+        }
+        for (size_t i = 0; i < h.n_frames; i++) {
+            const auto &entry = frame(i);
+            if (entry.offset % sizeof(uint32_t) || !entry.size ||
+                !entry.duration || entry.offset > mapped_size ||
+                (mapped_size - entry.offset) / sizeof(uint32_t) <
+                    entry.size) {
+                throw std::runtime_error(path + " has a bad frame table");
+            }
+        }
+        const size_t stream_size = expected_stream_size(path);
+        for (size_t i = 0; i < h.n_frames; i++) {
+            if (frame(i).size != stream_size) {
+                throw std::runtime_error(path + " has a stream of the wrong "
+                                                "length for its geometry");
+            }
+        }
+    }
+
+    // The length of each stream, from the geometry and schedule in the
+    // header, which are checked first so that the schedule can be made
+    size_t expected_stream_size(const std::string &path) const {
+        const auto &h = header();
+        bool valid = h.n_addr_lines <= std::size(h.pinout.addr) &&
+                     h.pixels_across && h.n_planes >= 1 &&
+                     h.n_temporal_planes >= 0 &&
+                     h.n_planes + h.n_temporal_planes <= 10 &&
+                     h.plane_spread >= 0 && h.plane_spread < h.n_planes;
+        // the address order must be a permutation of the rows
+        const size_t n_addr = valid ? size_t{1} << h.n_addr_lines : 0;
+        std::vector<size_t> order(h.addr_order, h.addr_order + n_addr);
+        std::vector<bool> seen(n_addr);
+        for (auto addr : order) {
+            valid = valid && addr < n_addr && !seen[addr];
+            seen[addr % n_addr] = true;
+        }
+        if (!valid) {
+            throw std::runtime_error(path + " has a bad geometry");
+        }
+        return protomatter_stream_size(
+            make_schedule(h.n_addr_lines, h.n_planes, h.plane_spread, order),
+            h.pixels_across, h.n_temporal_planes);
+    }
+
+    uint8_t *mapped = nullptr;
+    size_t mapped_size = 0;
+};
+
+} // namespace piomatter
@@ -25,6 +25,11 @@ template <class T> struct thread_queue {
         return val;
     }
 
+    bool empty() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queue.empty();
+    }
+
     T pop_blocking() {
         std::unique_lock<std::mutex> lock(mutex);
         while (queue.empty()) {
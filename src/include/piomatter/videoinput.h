@@ -0,0 +1,368 @@
+#pragma once
+
+#include "piomatter.h"
+#include "thread_queue.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <poll.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace piomatter {
+
+// Uncompressed video formats read by video_input: raw frames of packed RGB
+// pixels or of 4:2:0 YUV planes, or a YUV4MPEG2 stream with 4:2:0 chroma
+enum class video_format { rgb888_packed, rgb565, i420, nv12, y4m };
+
+// Show uncompressed video read from a pipe or file descriptor. A reader
+// thread reads each frame into one of two buffers while a second thread
+// converts and queues the other, with a presentation time from the stream's
+// frame rate; the blitter then shows each one on time. With `drop_late`, a
+// frame that is ready only once the next one is due is skipped, though never
+// two in a row, so that a source slower than its frame rate still shows.
+//
+// YUV frames are shown with `encoding`, except that a YUV4MPEG2 stream
+// declaring its range with XCOLORRANGE overrides the range.
+//
+// The descriptor is not closed, and must stay open while this runs.
+struct video_input {
+    video_input(piomatter_base &matter, int fd, size_t width, size_t height,
+                video_format format, double fps, bool drop_late, bool loop,
+                const yuv_encoding &encoding = {})
+        : matter{matter}, fd{fd}, width{width}, height{height},
+          format{format}, drop_late{drop_late}, loop{loop},
+          encoding{encoding} {
+        if (!(fps > 0)) {
+            throw std::range_error("the frame rate must be positive");
+        }
+        period = uint64_t(1e9 / fps);
+        free_slots.push(0);
+        free_slots.push(1);
+        read_thread = std::thread{&video_input::read_frames, this};
+        present_thread = std::thread{&video_input::present_frames, this};
+    }
+
+    video_input(const video_input &) = delete;
+    video_input &operator=(const video_input &) = delete;
+
+    ~video_input() {
+        exit_request = true;
+        free_slots.push(stop_slot);
+        filled_slots.push(stop_slot);
+        read_thread.join();
+        present_thread.join();
+    }
+
+    // Wait up to `timeout` seconds for the end of the stream; returns
+    // whether it has ended
+    bool wait(double timeout) {
+        std::unique_lock<std::mutex> lock(finished_mutex);
+        return finished_cv.wait_for(lock,
+                                    std::chrono::duration<double>(timeout),
+                                    [this] { return finished; });
+    }
+
+    // Why the stream ended early, if it did
+    std::string error() {
+        std::lock_guard<std::mutex> lock(finished_mutex);
+        return error_message;
+    }
+
+    // frames shown, frames that missed their time, and late frames skipped
+    std::atomic<uint64_t> frames{0}, frames_late{0}, frames_dropped{0};
+
+  private:
+    static constexpr int stop_slot = -1;
+
+    // Bytes are read through a small buffer, so that header lines can be
+    // read without a system call per byte; frame data is read directly
+    // into the frame buffers once the buffer is empty. Returns false at the
+    // end of the stream or on exit.
+    bool read_exact(uint8_t *dst, size_t n) {
+        size_t from_buffer = std::min(n, buffered.size() - buffer_pos);
+        memcpy(dst, buffered.data() + buffer_pos, from_buffer);
+        buffer_pos += from_buffer;
+        dst += from_buffer;
+        n -= from_buffer;
+        while (n) {
+            ssize_t r = read_some(dst, n);
+            if (r <= 0) {
+                return false;
+            }
+            dst += r;
+            n -= r;
+        }
+        return true;
+    }
+
+    bool read_line(std::string &line) {
+        line.clear();
+        while (true) {
+            if (buffer_pos == buffered.size()) {
+                buffered.resize(4096);
+                ssize_t r = read_some(buffered.data(), buffered.size());
+                buffered.resize(std::max<ssize_t>(r, 0));
+                buffer_pos = 0;
+                if (r <= 0) {
+                    return false;
+                }
+            }
+            char c = buffered[buffer_pos++];
+            if (c == '\n') {
+                return true;
+            }
+            if (line.size() > 1024) {
+                throw std::runtime_error("YUV4MPEG2 header line too long");
+            }
+            line += c;
+        }
+    }
+
+    // Wait for data in slices, so that an idle pipe doesn't keep the
+    // destructor waiting
+    ssize_t read_some(void *dst, size_t n) {
+        while (!exit_request) {
+            pollfd pfd{fd, POLLIN, 0};
+            if (poll(&pfd, 1, 100) == 0) {
+                continue;
+            }
+            ssize_t r = read(fd, dst, n);
+            if (r < 0 && (errno == EINTR || errno == EAGAIN)) {
+                continue;
+            }
+            if (r < 0) {
+                throw std::runtime_error(std::string("read: ") +
+                                         strerror(errno));
+            }
+            return r;
+        }
+        return 0;
+    }
+
+    // Parse the stream header after the "YUV4MPEG2" signature
+    void parse_y4m_header(const std::string &line) {
+        size_t stream_width = 0, stream_height = 0;
+        size_t pos = 0;
+        while (pos < line.size()) {
+            size_t end = line.find(' ', pos);
+            if (end == std::string::npos) {
+                end = line.size();
+            }
+            std::string token = line.substr(pos, end - pos);
+            pos = end + 1;
+            if (token.empty()) {
+                continue;
+            }
+            std::string value = token.substr(1);
+            switch (token[0]) {
+            case 'W':
+                stream_width = std::stoul(value);
+                break;
+            case 'H':
+                stream_height = std::stoul(value);
+                break;
+            case 'F': {
+                unsigned num = 0, den = 0;
+                if (sscanf(value.c_str(), "%u:%u", &num, &den) != 2 || !num ||
+                    !den) {
+                    throw std::runtime_error("invalid YUV4MPEG2 frame rate");
+                }
+                period = uint64_t(1e9 * den / num);
+                break;
+            }
+            case 'I':
+                if (value != "p" && value != "?") {
+                    throw std::runtime_error(
+                        "interlaced YUV4MPEG2 streams are not supported");
+                }
+                break;
+            case 'C':
+                if (value.compare(0, 3, "420")) {
+                    throw std::runtime_error(
+                        "only 4:2:0 YUV4MPEG2 streams are supported");
+                }
+                break;
+            case 'X':
+                if (value == "COLORRANGE=FULL") {
+                    encoding.full_range = true;
+                } else if (value == "COLORRANGE=LIMITED") {
+                    encoding.full_range = false;
+                }
+                break;
+            }
+        }
+        if (stream_width != width || stream_height != height) {
+            throw std::runtime_error(
+                "YUV4MPEG2 stream is " + std::to_string(stream_width) + "x" +
+                std::to_string(stream_height) + ", display is " +
+                std::to_string(width) + "x" + std::to_string(height));
+        }
+    }
+
+    size_t frame_size() const {
+        switch (format) {
+        case video_format::rgb888_packed:
+            return width * height * 3;
+        case video_format::rgb565:
+            return width * height * 2;
+        case video_format::i420:
+        case video_format::nv12:
+        case video_format::y4m:
+            return yuv_frame::size_in_bytes(width, height);
+        }
+        return 0;
+    }
+
+    // Read the stream header, if any, then each frame into a free slot
+    void read_frames() {
+        try {
+            std::string line;
+            if (format == video_format::y4m) {
+                if (!read_line(line) || line.compare(0, 10, "YUV4MPEG2 ")) {
+                    throw std::runtime_error("not a YUV4MPEG2 stream");
+                }
+                parse_y4m_header(line.substr(10));
+            }
+            // where to rewind to, when the descriptor can seek
+            off_t data_start = lseek(fd, 0, SEEK_CUR);
+            if (data_start >= 0) {
+                data_start -= buffered.size() - buffer_pos;
+            }
+            bool read_any = false;
+            for (auto &slot : slots) {
+                slot.resize(frame_size());
+            }
+            while (!exit_request) {
+                int slot = free_slots.pop_blocking();
+                if (slot == stop_slot) {
+                    break;
+                }
+                bool more = true;
+                if (format == video_format::y4m) {
+                    more = read_line(line);
+                    if (more && line.compare(0, 5, "FRAME")) {
+                        throw std::runtime_error(
+                            "invalid YUV4MPEG2 frame header");
+                    }
+                }
+                more = more && read_exact(slots[slot].data(), frame_size());
+                if (!more && loop && read_any && data_start >= 0 &&
+                    lseek(fd, data_start, SEEK_SET) == data_start) {
+                    buffered.clear();
+                    buffer_pos = 0;
+                    free_slots.push(slot);
+                    continue;
+                }
+                if (!more) {
+                    break;
+                }
+                read_any = true;
+                filled_slots.push(slot);
+            }
+        } catch (const std::exception &e) {
+            std::lock_guard<std::mutex> lock(finished_mutex);
+            error_message = e.what();
+        }
+        filled_slots.push(stop_slot);
+    }
+
+    void show(const uint8_t *frame, uint64_t present_at) {
+        switch (format) {
+        case video_format::rgb888_packed:
+            matter.show_as(pixel_format::rgb888_packed,
+                           {frame, width, height, ptrdiff_t(width * 3), 3},
+                           present_at);
+            break;
+        case video_format::rgb565:
+            matter.show_as(pixel_format::rgb565,
+                           {frame, width, height, ptrdiff_t(width * 2), 2},
+                           present_at);
+            break;
+        case video_format::i420:
+        case video_format::y4m:
+            matter.show_yuv(yuv_frame::i420(frame, width, height), encoding,
+                            present_at);
+            break;
+        case video_format::nv12:
+            matter.show_yuv(yuv_frame::nv12(frame, width, height), encoding,
+                            present_at);
+            break;
+        }
+    }
+
+    // Frame n is due n periods after the first one was ready. show()
+    // waits for a free buffer, so this runs at most two frames ahead of the
+    // display.
+    void present_frames() {
+        uint64_t start = 0, n = 0;
+        bool dropped = false;
+        try {
+            while (true) {
+                int slot = filled_slots.pop_blocking();
+                if (slot == stop_slot) {
+                    break;
+                }
+                uint64_t now = monotonicns64();
+                if (!start) {
+                    start = now;
+                }
+                uint64_t due = start + n++ * period;
+                if (now > due) {
+                    frames_late++;
+                    if (drop_late && now >= due + period && !dropped) {
+                        frames_dropped++;
+                        dropped = true;
+                        free_slots.push(slot);
+                        continue;
+                    }
+                }
+                dropped = false;
+                show(slots[slot].data(), due);
+                free_slots.push(slot);
+                frames++;
+            }
+            // the last frame is on display for a period too
+            uint64_t end = start + n * period;
+            while (start && !exit_request && monotonicns64() < end) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        } catch (const std::exception &e) {
+            std::lock_guard<std::mutex> lock(finished_mutex);
+            error_message = e.what();
+            // let the reader run into the end of its queue
+            exit_request = true;
+            free_slots.push(stop_slot);
+        }
+        std::lock_guard<std::mutex> lock(finished_mutex);
+        finished = true;
+        finished_cv.notify_all();
+    }
+
+    piomatter_base &matter;
+    int fd;
+    size_t width, height;
+    video_format format;
+    bool drop_late, loop;
+    yuv_encoding encoding;
+    // ns between frames
+    uint64_t period;
+    // the two frame buffers, and the queues passing them between threads
+    std::vector<uint8_t> slots[2];
+    thread_queue<int> free_slots, filled_slots;
+    // bytes read ahead of the frame data, and how many have been used
+    std::vector<uint8_t> buffered;
+    size_t buffer_pos = 0;
+    std::mutex finished_mutex;
+    std::condition_variable finished_cv;
+    bool finished = false;
+    std::string error_message;
+    std::atomic<bool> exit_request{false};
+    std::thread read_thread, present_thread;
+};
+
+} // namespace piomatter
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "render.h"
+
+namespace piomatter {
+
+enum class yuv_matrix { bt601, bt709 };
+
+// How YUV values encode RGB: the matrix of the standard, and whether luma
+// spans 0-255 or the usual 16-235 (with chroma 16-240)
+struct yuv_encoding {
+    yuv_matrix matrix = yuv_matrix::bt601;
+    bool full_range = false;
+
+    bool operator==(const yuv_encoding &) const = default;
+};
+
+// A frame of 8-bit YUV with 4:2:0 chroma. The chroma planes have a sample for
+// each 2x2 block of luma, rounded up, `uv_step` bytes apart: 1 for separate
+// U and V planes as in I420, or 2 for interleaved ones as in NV12.
+struct yuv_frame {
+    const uint8_t *y, *u, *v;
+    size_t width, height;
+    ptrdiff_t y_pitch, uv_pitch, uv_step;
+
+    static size_t chroma_width(size_t width) { return (width + 1) / 2; }
+    static size_t chroma_height(size_t height) { return (height + 1) / 2; }
+
+    static size_t size_in_bytes(size_t width, size_t height) {
+        return width * height +
+               2 * chroma_width(width) * chroma_height(height);
+    }
+
+    // Contiguous planes: Y, then U, then V
+    static yuv_frame i420(const uint8_t *data, size_t width, size_t height) {
+        size_t cw = chroma_width(width), ch = chroma_height(height);
+        const uint8_t *u = data + width * height;
+        return {data, u, u + cw * ch, width, height, ptrdiff_t(width),
+                ptrdiff_t(cw), 1};
+    }
+
+    // Contiguous planes: Y, then U and V interleaved
+    static yuv_frame nv12(const uint8_t *data, size_t width, size_t height) {
+        const uint8_t *uv = data + width * height;
+        return {data, uv, uv + 1, width, height, ptrdiff_t(width),
+                ptrdiff_t(2 * chroma_width(width)), 2};
+    }
+};
+
+// Converts YUV 4:2:0 frames to rgb10 in one pass: each chroma sample's
+// contribution to R, G and B is looked up once for its 2x2 block of luma,
+// added to each luma value's, and the resulting 8-bit RGB goes straight
+// through the gamma and calibration tables. There is no intermediate RGB
+// frame.
+struct yuv420_converter {
+    yuv420_converter(const matrix_geometry &geometry,
+                     const yuv_encoding &encoding = {}, float gamma = 2.2)
+        : tables{gamma, geometry.width}, dither{geometry},
+          width{geometry.width} {
+        set_encoding(encoding);
+    }
+
+    void set_calibration(const color_calibration &calibration) {
+        tables = calibrated_lut{calibration, width};
+    }
+
+    // Fill the tables, in 16.16 fixed point, from the standard's luma
+    // weights of red and blue
+    void set_encoding(const yuv_encoding &encoding) {
+        this->encoding = encoding;
+        double kr = 0.299, kb = 0.114;
+        if (encoding.matrix == yuv_matrix::bt709) {
+            kr = 0.2126;
+            kb = 0.0722;
+        }
+        double kg = 1 - kr - kb;
+        double y_offset = 16, y_scale = 255 / 219., c_scale = 255 / 224.;
+        if (encoding.full_range) {
+            y_offset = 0;
+            y_scale = c_scale = 1;
+        }
+        auto fixed = [](double v) { return int32_t(round(v * 65536)); };
+        for (int i = 0; i < 256; i++) {
+            // rounding to nearest is folded into the luma term
+            y_term[i] = fixed(y_scale * (i - y_offset)) + 32768;
+            double c = c_scale * (i - 128);
+            r_v[i] = fixed(2 * (1 - kr) * c);
+            g_u[i] = fixed(-2 * kb * (1 - kb) / kg * c);
+            g_v[i] = fixed(-2 * kr * (1 - kr) / kg * c);
+            b_u[i] = fixed(2 * (1 - kb) * c);
+        }
+    }
+
+    const std::span<const uint32_t> convert(const yuv_frame &frame) {
+        rgb10.resize(frame.width * frame.height);
+        if (tables.channels.size()) {
+            convert(tables.channels, frame);
+        } else {
+            convert(tables.matrices, frame);
+        }
+        dither.apply(rgb10);
+        return rgb10;
+    }
+
+    template <typename Lut>
+    void convert(const std::vector<Lut> &luts, const yuv_frame &frame) {
+        auto clamp8 = [](int32_t v) { return std::clamp(v >> 16, 0, 255); };
+        for (size_t y = 0; y < frame.height; y++) {
+            const uint8_t *yp = frame.y + ptrdiff_t(y) * frame.y_pitch;
+            ptrdiff_t uv_row = ptrdiff_t(y / 2) * frame.uv_pitch;
+            const uint8_t *up = frame.u + uv_row, *vp = frame.v + uv_row;
+            uint32_t *out = rgb10.data() + y * frame.width;
+            for (size_t x = 0; x < frame.width; x += 2) {
+                int32_t r = r_v[*vp], g = g_u[*up] + g_v[*vp], b = b_u[*up];
+                up += frame.uv_step;
+                vp += frame.uv_step;
+                for (size_t i = x; i < std::min(x + 2, frame.width); i++) {
+                    int32_t l = y_term[yp[i]];
+                    const auto &lut = luts[tables.tile(i, y)];
+                    out[i] = lut.convert(clamp8(l + r), clamp8(l + g),
+                                         clamp8(l + b));
+                }
+            }
+        }
+    }
+
+    calibrated_lut tables;
+    ordered_dither dither;
+    size_t width;
+    yuv_encoding encoding;
+    int32_t y_term[256], r_v[256], g_u[256], g_v[256], b_u[256];
+    std::vector<uint32_t> rgb10;
+};
+
+} // namespace piomatter
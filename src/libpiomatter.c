@@ -0,0 +1,257 @@
+// The C interface declared in piomatter/piomatter_c.h, built into
+// libpiomatter.so
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include "piomatter/piomatter.h"
+#include "piomatter/piomatter_c.h"
+#include "piomatter/videoinput.h"
+
+struct piomatter_handle {
+    std::unique_ptr<piomatter::piomatter_base> matter;
+    // destroyed before the display it shows on
+    std::unique_ptr<piomatter::video_input> video;
+    size_t width, height, pixel_size;
+    std::string last_error;
+};
+
+namespace {
+
+piomatter::matrix_geometry make_geometry(const piomatter_config &c) {
+    piomatter::orientation rotation;
+    switch (c.orientation) {
+    case PIOMATTER_ORIENTATION_NORMAL:
+        rotation = piomatter::orientation::normal;
+        break;
+    case PIOMATTER_ORIENTATION_R180:
+        rotation = piomatter::orientation::r180;
+        break;
+    case PIOMATTER_ORIENTATION_CCW:
+        rotation = piomatter::orientation::ccw;
+        break;
+    case PIOMATTER_ORIENTATION_CW:
+        rotation = piomatter::orientation::cw;
+        break;
+    default:
+        throw std::runtime_error("invalid orientation");
+    }
+    auto result = piomatter::make_panel_geometry(
+        c.width, c.height, c.n_addr_lines, c.serpentine, rotation, c.n_planes,
+        c.n_temporal_planes);
+    result.plane_spread = c.plane_spread;
+    return result;
+}
+
+template <typename pinout, typename colorspace>
+std::unique_ptr<piomatter::piomatter_base>
+make_piomatter_pc(const piomatter::matrix_geometry &geometry) {
+    // a black frame, shown only by the constructor
+    std::vector<typename colorspace::data_type> black(
+        colorspace::data_size_in_bytes(geometry.width * geometry.height) /
+        sizeof(typename colorspace::data_type));
+    return std::make_unique<piomatter::piomatter<pinout, colorspace>>(
+        black, geometry);
+}
+
+template <typename pinout>
+std::unique_ptr<piomatter::piomatter_base>
+make_piomatter_p(piomatter_colorspace c,
+                 const piomatter::matrix_geometry &geometry) {
+    switch (c) {
+    case PIOMATTER_COLORSPACE_RGB565:
+        return make_piomatter_pc<pinout, piomatter::colorspace_rgb565>(
+            geometry);
+    case PIOMATTER_COLORSPACE_RGB888:
+        return make_piomatter_pc<pinout, piomatter::colorspace_rgb888>(
+            geometry);
+    case PIOMATTER_COLORSPACE_RGB888_PACKED:
+        return make_piomatter_pc<pinout, piomatter::colorspace_rgb888_packed>(
+            geometry);
+    }
+    throw std::runtime_error("invalid colorspace");
+}
+
+std::unique_ptr<piomatter::piomatter_base>
+make_piomatter(const piomatter_config &c,
+               const piomatter::matrix_geometry &geometry) {
+    switch (c.pinout) {
+    case PIOMATTER_PINOUT_ADAFRUIT_BONNET:
+        return make_piomatter_p<piomatter::adafruit_matrix_bonnet_pinout>(
+            c.colorspace, geometry);
+    case PIOMATTER_PINOUT_ADAFRUIT_BONNET_BGR:
+        return make_piomatter_p<piomatter::adafruit_matrix_bonnet_pinout_bgr>(
+            c.colorspace, geometry);
+    }
+    throw std::runtime_error("invalid pinout");
+}
+
+// Run `f`, turning exceptions into a -1 return and the handle's last error
+template <typename F> int guard(piomatter_handle *handle, const F &f) {
+    try {
+        f();
+        return 0;
+    } catch (const std::exception &e) {
+        handle->last_error = e.what();
+        return -1;
+    }
+}
+
+} // namespace
+
+extern "C" {
+
+void piomatter_config_init(piomatter_config *config) {
+    *config = {};
+    config->width = 64;
+    config->height = 32;
+    config->n_addr_lines = 4;
+    config->n_planes = 10;
+    config->serpentine = 1;
+    config->orientation = PIOMATTER_ORIENTATION_NORMAL;
+    config->pinout = PIOMATTER_PINOUT_ADAFRUIT_BONNET;
+    config->colorspace = PIOMATTER_COLORSPACE_RGB888_PACKED;
+    config->brightness = 1;
+}
+
+size_t piomatter_pixel_size(piomatter_colorspace colorspace) {
+    switch (colorspace) {
+    case PIOMATTER_COLORSPACE_RGB565:
+        return piomatter::colorspace_rgb565::data_size_in_bytes(1);
+    case PIOMATTER_COLORSPACE_RGB888:
+        return piomatter::colorspace_rgb888::data_size_in_bytes(1);
+    case PIOMATTER_COLORSPACE_RGB888_PACKED:
+        return piomatter::colorspace_rgb888_packed::data_size_in_bytes(1);
+    }
+    return 0;
+}
+
+piomatter_handle *piomatter_create(const piomatter_config *config,
+                                   char *error, size_t error_size) {
+    try {
+        if (!(config->brightness >= 0 && config->brightness <= 1)) {
+            throw std::range_error("brightness must be from 0 to 1");
+        }
+        auto geometry = make_geometry(*config);
+        auto handle = std::make_unique<piomatter_handle>();
+        handle->width = config->width;
+        handle->height = config->height;
+        handle->pixel_size = piomatter_pixel_size(config->colorspace);
+        handle->matter = make_piomatter(*config, geometry);
+        handle->matter->set_brightness(config->brightness, {});
+        return handle.release();
+    } catch (const std::exception &e) {
+        if (error && error_size) {
+            snprintf(error, error_size, "%s", e.what());
+        }
+        return nullptr;
+    }
+}
+
+void piomatter_destroy(piomatter_handle *handle) { delete handle; }
+
+int piomatter_show(piomatter_handle *handle, const void *frame,
+                   ptrdiff_t row_pitch) {
+    return guard(handle, [&] {
+        auto pitch = row_pitch ? row_pitch
+                               : ptrdiff_t(handle->width * handle->pixel_size);
+        handle->matter->show(
+            {static_cast<const uint8_t *>(frame), handle->width,
+             handle->height, pitch, ptrdiff_t(handle->pixel_size)});
+    });
+}
+
+int piomatter_set_brightness(piomatter_handle *handle, double brightness) {
+    return guard(handle, [&] {
+        if (brightness < 0 || brightness > 1) {
+            throw std::range_error("brightness must be from 0 to 1");
+        }
+        handle->matter->set_brightness(brightness, {});
+    });
+}
+
+double piomatter_fps(const piomatter_handle *handle) {
+    return handle->matter->fps;
+}
+
+double piomatter_pwm_frequency(const piomatter_handle *handle) {
+    return handle->matter->pwm_frequency;
+}
+
+void piomatter_video_options_init(piomatter_video_options *options) {
+    *options = {};
+    options->format = PIOMATTER_VIDEO_Y4M;
+    options->fps = 30;
+}
+
+int piomatter_play_fd(piomatter_handle *handle, int fd,
+                      const piomatter_video_options *options) {
+    return guard(handle, [&] {
+        piomatter::video_format format;
+        switch (options->format) {
+        case PIOMATTER_VIDEO_RGB888_PACKED:
+            format = piomatter::video_format::rgb888_packed;
+            break;
+        case PIOMATTER_VIDEO_RGB565:
+            format = piomatter::video_format::rgb565;
+            break;
+        case PIOMATTER_VIDEO_Y4M:
+            format = piomatter::video_format::y4m;
+            break;
+        case PIOMATTER_VIDEO_I420:
+            format = piomatter::video_format::i420;
+            break;
+        case PIOMATTER_VIDEO_NV12:
+            format = piomatter::video_format::nv12;
+            break;
+        default:
+            throw std::runtime_error("invalid video format");
+        }
+        piomatter::yuv_encoding encoding;
+        if (options->yuv_matrix == PIOMATTER_YUV_BT709) {
+            encoding.matrix = piomatter::yuv_matrix::bt709;
+        }
+        encoding.full_range = options->full_range;
+        handle->video.reset();
+        handle->video = std::make_unique<piomatter::video_input>(
+            *handle->matter, fd, handle->width, handle->height, format,
+            options->fps, options->drop_late, options->loop, encoding);
+    });
+}
+
+int piomatter_video_wait(piomatter_handle *handle, double timeout) {
+    if (!handle->video) {
+        handle->last_error = "no video is playing";
+        return -1;
+    }
+    if (!handle->video->wait(timeout)) {
+        return 0;
+    }
+    auto error = handle->video->error();
+    if (!error.empty()) {
+        handle->last_error = error;
+        return -1;
+    }
+    return 1;
+}
+
+int piomatter_video_stats(piomatter_handle *handle,
+                          struct piomatter_video_stats *stats) {
+    if (!handle->video) {
+        handle->last_error = "no video is playing";
+        return -1;
+    }
+    stats->frames = handle->video->frames;
+    stats->frames_late = handle->video->frames_late;
+    stats->frames_dropped = handle->video->frames_dropped;
+    return 0;
+}
+
+void piomatter_stop_video(piomatter_handle *handle) { handle->video.reset(); }
+
+const char *piomatter_last_error(const piomatter_handle *handle) {
+    return handle->last_error.c_str();
+}
+
+} // extern "C"
@@ -0,0 +1,332 @@
+// piomatterd: owns the matrix hardware and shows frames from local clients
+//
+// The daemon keeps refreshing the last frame shown while clients come and
+// go, so restarting or switching the program that draws doesn't blank the
+// display. Clients connect to a Unix seqpacket socket and exchange one-line
+// text messages:
+//
+//   on connect        <- "piomatterd 1 <width> <height> <pixel_size>"
+//   "ring [n_slots]"  <- "ok <name>": a frame ring in shared memory, see
+//                        piomatter/shmring.h, for this client's frames, with
+//                        2 to 16 slots (3)
+//   "brightness <b>"  <- "ok"
+//   anything else     <- "error <message>"
+//
+// A client's ring is removed when it disconnects; its last frame stays on
+// the display until another client shows one.
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <map>
+#include <memory>
+#include <poll.h>
+#include <string>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+#include "piomatter/piomatter.h"
+#include "piomatter/shmring.h"
+
+namespace {
+
+struct options {
+    size_t width = 64, height = 32, n_addr_lines = 4;
+    int n_planes = 10;
+    bool serpentine = true;
+    std::string orientation = "normal";
+    std::string pinout = "bonnet";
+    std::string colorspace = "rgb888packed";
+    std::string socket_path = "/run/piomatterd.sock";
+    double brightness = 1;
+};
+
+void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --width N          display width in pixels (64)\n"
+            "  --height N         display height in pixels (32)\n"
+            "  --addr-lines N     number of address lines (4)\n"
+            "  --planes N         number of bit planes (10)\n"
+            "  --no-serpentine    panels are not wired in a serpentine\n"
+            "  --orientation O    normal, r180, cw or ccw\n"
+            "  --pinout P         bonnet or bonnet-bgr\n"
+            "  --colorspace C     rgb565, rgb888 or rgb888packed\n"
+            "  --brightness B     from 0 to 1 (1)\n"
+            "  --socket PATH      (/run/piomatterd.sock)\n",
+            argv0);
+}
+
+piomatter::matrix_geometry make_geometry(const options &o) {
+    piomatter::orientation rotation;
+    if (o.orientation == "normal") {
+        rotation = piomatter::orientation::normal;
+    } else if (o.orientation == "r180") {
+        rotation = piomatter::orientation::r180;
+    } else if (o.orientation == "cw") {
+        rotation = piomatter::orientation::cw;
+    } else if (o.orientation == "ccw") {
+        rotation = piomatter::orientation::ccw;
+    } else {
+        throw std::runtime_error("invalid orientation " + o.orientation);
+    }
+    return piomatter::make_panel_geometry(o.width, o.height, o.n_addr_lines,
+                                          o.serpentine, rotation, o.n_planes);
+}
+
+int listen_on(const std::string &path) {
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    sockaddr_un sa{};
+    sa.sun_family = AF_UNIX;
+    if (fd < 0 || path.size() >= sizeof(sa.sun_path)) {
+        throw std::runtime_error("socket " + path);
+    }
+    strcpy(sa.sun_path, path.c_str());
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr *>(&sa), sizeof(sa)) < 0 ||
+        chmod(path.c_str(), 0660) < 0 || listen(fd, 8) < 0) {
+        throw std::runtime_error("listen on " + path + ": " +
+                                 strerror(errno));
+    }
+    return fd;
+}
+
+// Parse a whole argument as an integer from `min` to `max`
+long parse_integer(const char *arg, long min, long max, const char *what) {
+    char *end;
+    errno = 0;
+    long value = strtol(arg, &end, 10);
+    if (end == arg || *end || errno || value < min || value > max) {
+        throw std::range_error(std::string(what) + " must be an integer from " +
+                               std::to_string(min) + " to " +
+                               std::to_string(max));
+    }
+    return value;
+}
+
+double parse_brightness(const char *arg) {
+    char *end;
+    double value = strtod(arg, &end);
+    if (end == arg || *end || !(value >= 0 && value <= 1)) {
+        throw std::range_error("brightness must be from 0 to 1");
+    }
+    return value;
+}
+
+struct client {
+    std::unique_ptr<piomatter::shm_ring_consumer> ring;
+};
+
+struct display_server {
+    display_server(piomatter::piomatter_base &matter, const options &o,
+                   size_t pixel_size)
+        : matter{matter}, o{o}, pixel_size{pixel_size} {}
+
+    void reply(int fd, const std::string &message) {
+        send(fd, message.data(), message.size(), MSG_NOSIGNAL);
+    }
+
+    std::string handle(int fd, const std::string &message) {
+        char command[32] = "", arg[32] = "", extra;
+        int n = sscanf(message.c_str(), "%31s %31s %c", command, arg, &extra);
+        if (n == 3) {
+            throw std::runtime_error("too many arguments");
+        }
+        if (n >= 1 && !strcmp(command, "ring")) {
+            size_t n_slots = n == 2 ? parse_integer(arg, 2, 16, "n_slots") : 3;
+            auto name = "/piomatterd." + std::to_string(getpid()) + "." +
+                        std::to_string(fd) + "." +
+                        std::to_string(++rings_created);
+            auto &c = clients[fd];
+            c.ring.reset();
+            c.ring = std::make_unique<piomatter::shm_ring_consumer>(
+                name, o.width, o.height, pixel_size, n_slots,
+                [&matter = matter](const auto &frame) { matter.show(frame); });
+            return "ok " + name;
+        } else if (n == 2 && !strcmp(command, "brightness")) {
+            matter.set_brightness(parse_brightness(arg), {});
+            return "ok";
+        }
+        throw std::runtime_error("unknown command");
+    }
+
+    // Serve clients until `signal_fd` is readable
+    void run(int listen_fd, int signal_fd) {
+        while (true) {
+            std::vector<pollfd> fds{{listen_fd, POLLIN, 0},
+                                    {signal_fd, POLLIN, 0}};
+            for (const auto &[fd, c] : clients) {
+                fds.push_back({fd, POLLIN, 0});
+            }
+            if (poll(fds.data(), fds.size(), -1) < 0) {
+                continue;
+            }
+            if (fds[1].revents) {
+                break;
+            }
+            if (fds[0].revents & POLLIN) {
+                int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd >= 0) {
+                    clients[fd];
+                    reply(fd, "piomatterd 1 " + std::to_string(o.width) +
+                                  " " + std::to_string(o.height) + " " +
+                                  std::to_string(pixel_size));
+                }
+            }
+            for (size_t i = 2; i < fds.size(); i++) {
+                if (!fds[i].revents) {
+                    continue;
+                }
+                int fd = fds[i].fd;
+                char buf[256];
+                ssize_t len = recv(fd, buf, sizeof(buf) - 1, 0);
+                if (len <= 0) {
+                    clients.erase(fd);
+                    close(fd);
+                    continue;
+                }
+                buf[len] = 0;
+                try {
+                    reply(fd, handle(fd, buf));
+                } catch (const std::exception &e) {
+                    reply(fd, std::string("error ") + e.what());
+                }
+            }
+        }
+        for (const auto &[fd, c] : clients) {
+            close(fd);
+        }
+        clients.clear();
+    }
+
+    piomatter::piomatter_base &matter;
+    const options &o;
+    size_t pixel_size;
+    std::map<int, client> clients;
+    uint64_t rings_created = 0;
+};
+
+template <typename pinout, typename colorspace>
+void run(const options &o, int signal_fd) {
+    auto geometry = make_geometry(o);
+    std::vector<typename colorspace::data_type> framebuffer(
+        colorspace::data_size_in_bytes(o.width * o.height) /
+        sizeof(typename colorspace::data_type));
+    piomatter::piomatter<pinout, colorspace> matter(framebuffer, geometry);
+    matter.set_brightness(o.brightness, {});
+
+    int listen_fd = listen_on(o.socket_path);
+    display_server server{matter, o, colorspace::data_size_in_bytes(1)};
+    server.run(listen_fd, signal_fd);
+    close(listen_fd);
+    unlink(o.socket_path.c_str());
+}
+
+template <typename pinout> void run_p(const options &o, int signal_fd) {
+    if (o.colorspace == "rgb565") {
+        run<pinout, piomatter::colorspace_rgb565>(o, signal_fd);
+    } else if (o.colorspace == "rgb888") {
+        run<pinout, piomatter::colorspace_rgb888>(o, signal_fd);
+    } else if (o.colorspace == "rgb888packed") {
+        run<pinout, piomatter::colorspace_rgb888_packed>(o, signal_fd);
+    } else {
+        throw std::runtime_error("invalid colorspace " + o.colorspace);
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    static const option long_options[] = {
+        {"width", required_argument, nullptr, 'w'},
+        {"height", required_argument, nullptr, 'h'},
+        {"addr-lines", required_argument, nullptr, 'a'},
+        {"planes", required_argument, nullptr, 'p'},
+        {"no-serpentine", no_argument, nullptr, 'S'},
+        {"orientation", required_argument, nullptr, 'o'},
+        {"pinout", required_argument, nullptr, 'P'},
+        {"colorspace", required_argument, nullptr, 'c'},
+        {"brightness", required_argument, nullptr, 'b'},
+        {"socket", required_argument, nullptr, 's'},
+        {nullptr, 0, nullptr, 0},
+    };
+    options o;
+    int opt;
+    try {
+        while ((opt = getopt_long(argc, argv, "", long_options, nullptr)) !=
+               -1) {
+            switch (opt) {
+            case 'w':
+                o.width = parse_integer(optarg, 1, 8192, "width");
+                break;
+            case 'h':
+                o.height = parse_integer(optarg, 1, 8192, "height");
+                break;
+            case 'a':
+                o.n_addr_lines = parse_integer(optarg, 1, 5, "addr-lines");
+                break;
+            case 'p':
+                o.n_planes = parse_integer(optarg, 1, 10, "planes");
+                break;
+            case 'S':
+                o.serpentine = false;
+                break;
+            case 'o':
+                o.orientation = optarg;
+                break;
+            case 'P':
+                o.pinout = optarg;
+                break;
+            case 'c':
+                o.colorspace = optarg;
+                break;
+            case 'b':
+                o.brightness = parse_brightness(optarg);
+                break;
+            case 's':
+                o.socket_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+            }
+        }
+    } catch (const std::exception &e) {
+        fprintf(stderr, "piomatterd: %s\n", e.what());
+        usage(argv[0]);
+        return 2;
+    }
+
+    // Block the exit signals before any thread starts, so that all threads
+    // inherit the mask and the signals are only seen through the signalfd
+    sigset_t exit_signals;
+    sigemptyset(&exit_signals);
+    sigaddset(&exit_signals, SIGINT);
+    sigaddset(&exit_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &exit_signals, nullptr);
+    int signal_fd = signalfd(-1, &exit_signals, SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        perror("piomatterd: signalfd");
+        return 1;
+    }
+
+    try {
+        if (o.pinout == "bonnet") {
+            run_p<piomatter::adafruit_matrix_bonnet_pinout>(o, signal_fd);
+        } else if (o.pinout == "bonnet-bgr") {
+            run_p<piomatter::adafruit_matrix_bonnet_pinout_bgr>(o, signal_fd);
+        } else {
+            throw std::runtime_error("invalid pinout " + o.pinout);
+        }
+    } catch (const std::exception &e) {
+        fprintf(stderr, "piomatterd: %s\n", e.what());
+        return 1;
+    }
+}
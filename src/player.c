@@ -0,0 +1,218 @@
+// player: show raw or YUV4MPEG2 video on the matrix, without Python
+//
+// Frames are read from a file, or from standard input when none is given,
+// so a decoder can feed the display directly:
+//
+//   ffmpeg -i clip.mp4 -vf scale=64:32 -f yuv4mpegpipe - | player
+//
+// YUV4MPEG2 input must match the display's size, and is shown at the rate
+// in its header. Raw input is a sequence of frames of the display's size, as
+// packed RGB888 or RGB565 pixels or I420 or NV12 planes, shown at --fps.
+//
+// This is plain C, built against piomatter/piomatter_c.h and libpiomatter.so.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <float.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "piomatter/piomatter_c.h"
+
+static volatile sig_atomic_t exit_requested = 0;
+
+static void request_exit(int sig) {
+    (void)sig;
+    exit_requested = 1;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [options] [file]\n"
+            "  --width N          display width in pixels (64)\n"
+            "  --height N         display height in pixels (32)\n"
+            "  --addr-lines N     number of address lines (4)\n"
+            "  --planes N         number of bit planes (10)\n"
+            "  --temporal-planes N\n"
+            "                     number of temporal dithering planes (0)\n"
+            "  --no-serpentine    panels are not wired in a serpentine\n"
+            "  --orientation O    normal, r180, cw or ccw\n"
+            "  --pinout P         bonnet or bonnet-bgr\n"
+            "  --brightness B     from 0 to 1 (1)\n"
+            "  --format F         y4m, rgb24, rgb565, i420 or nv12 (y4m)\n"
+            "  --fps F            frame rate of raw input (30)\n"
+            "  --bt709            YUV uses the BT.709 matrix, not BT.601\n"
+            "  --full-range       YUV spans 0-255, not 16-235\n"
+            "  --drop-late        skip frames that miss their time\n"
+            "  --loop             rewind a file at its end\n",
+            argv0);
+}
+
+static int parse_choice(const char *arg, const char *const *names) {
+    for (int i = 0; names[i]; i++) {
+        if (!strcmp(arg, names[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Parse a whole argument as a number; returns -1 if it isn't one, or isn't
+// from `min` to `max`
+static int parse_number(const char *arg, double min, double max,
+                        double *value) {
+    char *end;
+    *value = strtod(arg, &end);
+    return end == arg || *end || !(*value >= min && *value <= max) ? -1 : 0;
+}
+
+static const char *const orientation_names[] = {"normal", "r180", "ccw", "cw",
+                                                NULL};
+static const char *const pinout_names[] = {"bonnet", "bonnet-bgr", NULL};
+// in the order of enum piomatter_video_format
+static const char *const format_names[] = {"rgb24", "rgb565", "y4m",
+                                           "i420", "nv12", NULL};
+
+int main(int argc, char **argv) {
+    static const struct option long_options[] = {
+        {"width", required_argument, NULL, 'w'},
+        {"height", required_argument, NULL, 'h'},
+        {"addr-lines", required_argument, NULL, 'a'},
+        {"planes", required_argument, NULL, 'p'},
+        {"temporal-planes", required_argument, NULL, 't'},
+        {"no-serpentine", no_argument, NULL, 'S'},
+        {"orientation", required_argument, NULL, 'o'},
+        {"pinout", required_argument, NULL, 'P'},
+        {"brightness", required_argument, NULL, 'b'},
+        {"format", required_argument, NULL, 'F'},
+        {"fps", required_argument, NULL, 'f'},
+        {"bt709", no_argument, NULL, '7'},
+        {"full-range", no_argument, NULL, 'R'},
+        {"drop-late", no_argument, NULL, 'd'},
+        {"loop", no_argument, NULL, 'l'},
+        {NULL, 0, NULL, 0},
+    };
+    struct piomatter_config config;
+    piomatter_config_init(&config);
+    struct piomatter_video_options video;
+    piomatter_video_options_init(&video);
+    int opt, choice;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'w':
+            config.width = atoi(optarg);
+            break;
+        case 'h':
+            config.height = atoi(optarg);
+            break;
+        case 'a':
+            config.n_addr_lines = atoi(optarg);
+            break;
+        case 'p':
+            config.n_planes = atoi(optarg);
+            break;
+        case 't':
+            config.n_temporal_planes = atoi(optarg);
+            break;
+        case 'S':
+            config.serpentine = 0;
+            break;
+        case 'o':
+            if ((choice = parse_choice(optarg, orientation_names)) < 0) {
+                goto bad_usage;
+            }
+            config.orientation = (enum piomatter_orientation)choice;
+            break;
+        case 'P':
+            if ((choice = parse_choice(optarg, pinout_names)) < 0) {
+                goto bad_usage;
+            }
+            config.pinout = (enum piomatter_pinout)choice;
+            break;
+        case 'b':
+            if (parse_number(optarg, 0, 1, &config.brightness) < 0) {
+                goto bad_usage;
+            }
+            break;
+        case 'F':
+            if ((choice = parse_choice(optarg, format_names)) < 0) {
+                goto bad_usage;
+            }
+            video.format = (enum piomatter_video_format)choice;
+            break;
+        case 'f':
+            if (parse_number(optarg, 0, DBL_MAX, &video.fps) < 0 ||
+                !(video.fps > 0)) {
+                goto bad_usage;
+            }
+            break;
+        case '7':
+            video.yuv_matrix = PIOMATTER_YUV_BT709;
+            break;
+        case 'R':
+            video.full_range = 1;
+            break;
+        case 'd':
+            video.drop_late = 1;
+            break;
+        case 'l':
+            video.loop = 1;
+            break;
+        default:
+            goto bad_usage;
+        }
+    }
+    if (argc - optind > 1) {
+    bad_usage:
+        usage(argv[0]);
+        return 2;
+    }
+
+    int fd = STDIN_FILENO;
+    if (optind < argc &&
+        (fd = open(argv[optind], O_RDONLY | O_CLOEXEC)) < 0) {
+        fprintf(stderr, "player: %s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+
+    char error[256];
+    piomatter_handle *matter = piomatter_create(&config, error, sizeof(error));
+    if (!matter) {
+        fprintf(stderr, "player: %s\n", error);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = request_exit;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int status = 0;
+    if (piomatter_play_fd(matter, fd, &video) < 0) {
+        status = -1;
+    }
+    while (!status && !exit_requested) {
+        status = piomatter_video_wait(matter, 0.1);
+    }
+    if (status < 0) {
+        fprintf(stderr, "player: %s\n", piomatter_last_error(matter));
+    }
+
+    struct piomatter_video_stats stats;
+    if (piomatter_video_stats(matter, &stats) == 0) {
+        fprintf(stderr,
+                "player: %llu frames, %llu late, %llu dropped; "
+                "refresh %.1f Hz, PWM %.0f Hz\n",
+                (unsigned long long)stats.frames,
+                (unsigned long long)stats.frames_late,
+                (unsigned long long)stats.frames_dropped,
+                piomatter_fps(matter), piomatter_pwm_frequency(matter));
+    }
+    piomatter_destroy(matter);
+    return status < 0;
+}
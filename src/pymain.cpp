@@ -1,8 +1,21 @@
 #include <iostream>
+#include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <functional>
+#include <map>
+#include <optional>
 #include <string>
+#include <unistd.h>
+#include <variant>
 
+#include "piomatter/ddp.h"
+#include "piomatter/fbmirror.h"
 #include "piomatter/piomatter.h"
+#include "piomatter/scroller.h"
+#include "piomatter/shmring.h"
+#include "piomatter/streamfile.h"
+#include "piomatter/videoinput.h"
 
 #define STRINGIFY(x) #x
 #define MACRO_STRINGIFY(x) STRINGIFY(x)
@@ -10,43 +23,604 @@
 namespace py = pybind11;
 
 namespace {
+using byte_view = piomatter::framebuffer_view<uint8_t>;
+
+using durations_arg = std::variant<double, std::vector<double>>;
+
+// One duration for each of n_frames frames, from one for all or a list
+std::vector<double> expand_durations(const durations_arg &durations,
+                                     size_t n_frames) {
+    if (auto *d = std::get_if<double>(&durations)) {
+        return std::vector<double>(n_frames, *d);
+    }
+    return std::get<std::vector<double>>(durations);
+}
+
 struct PyPiomatter {
     PyPiomatter(py::buffer buffer,
-                std::unique_ptr<piomatter::piomatter_base> &&matter)
-        : buffer{buffer}, matter{std::move(matter)} {}
+                std::unique_ptr<piomatter::piomatter_base> &&matter,
+                std::function<byte_view(const py::buffer &, bool)> make_view,
+                size_t width, size_t height, size_t pixel_size)
+        : buffer{buffer}, matter{std::move(matter)},
+          make_view{std::move(make_view)}, width{width}, height{height},
+          pixel_size{pixel_size} {}
     py::buffer buffer;
     std::unique_ptr<piomatter::piomatter_base> matter;
+    // checks that a buffer, or a canvas, matches the geometry and colorspace
+    std::function<byte_view(const py::buffer &, bool)> make_view;
+    size_t width, height, pixel_size;
+    // declared after `matter`, so that they stop before `matter` is destroyed
+    std::unique_ptr<piomatter::fbdev_mirror> mirror;
+    std::unique_ptr<piomatter::viewport_scroller> scroller;
+    std::unique_ptr<piomatter::ddp_receiver> receiver;
+    std::unique_ptr<piomatter::shm_ring_consumer> ring;
+    std::unique_ptr<piomatter::video_input> video;
+
+    size_t canvas_width = 0, canvas_height = 0;
+    std::pair<size_t, size_t> viewport_position{0, 0};
+
+    void set_canvas(const py::buffer &canvas) {
+        auto view = make_view(canvas, true);
+        if (view.width != canvas_width || view.height != canvas_height) {
+            end_scroll();
+            viewport_position = {0, 0};
+        }
+        matter->set_canvas(view);
+        canvas_width = view.width;
+        canvas_height = view.height;
+        matter->show_viewport(viewport().first, viewport().second);
+    }
+
+    std::pair<size_t, size_t> viewport() const {
+        if (scroller) {
+            return {scroller->x, scroller->y};
+        }
+        return viewport_position;
+    }
+
+    void set_viewport(std::pair<size_t, size_t> position) {
+        end_scroll();
+        matter->show_viewport(position.first, position.second);
+        viewport_position = position;
+    }
+
+    void scroll(double dx, double dy) {
+        if (!canvas_width) {
+            throw std::runtime_error("scrolling needs a canvas; call "
+                                     "set_canvas() first");
+        }
+        end_scroll();
+        auto [x, y] = viewport_position;
+        scroller = std::make_unique<piomatter::viewport_scroller>(
+            *matter, canvas_width - width + 1, canvas_height - height + 1, x,
+            y, dx, dy);
+    }
+
+    // Stop the scroller, returning why it had stopped early, if it had
+    std::string end_scroll() {
+        std::string error;
+        if (scroller) {
+            viewport_position = viewport();
+            error = scroller->error();
+            scroller.reset();
+        }
+        return error;
+    }
+
+    void stop_scroll() {
+        auto error = end_scroll();
+        if (!error.empty()) {
+            throw std::runtime_error("scrolling had stopped: " + error);
+        }
+    }
+
+    void mirror_framebuffer(const std::string &device, size_t x_offset,
+                            size_t y_offset, size_t scale, double rate) {
+        mirror.reset();
+        mirror = std::make_unique<piomatter::fbdev_mirror>(
+            *matter, device, x_offset, y_offset, width, height, pixel_size,
+            scale, rate);
+    }
+
+    void stop_mirror() { mirror.reset(); }
+
+    void receive_ddp(uint16_t port, const std::string &address) {
+        receiver.reset();
+        receiver = std::make_unique<piomatter::ddp_receiver>(
+            *matter, width, height, address, port);
+    }
+
+    void stop_ddp() { receiver.reset(); }
+
+    void serve_frame_ring(const std::string &name, size_t n_slots) {
+        ring.reset();
+        ring = std::make_unique<piomatter::shm_ring_consumer>(
+            name, width, height, pixel_size, n_slots,
+            [matter = matter.get()](const byte_view &frame) {
+                matter->show(frame);
+            });
+    }
+
+    void stop_frame_ring() { ring.reset(); }
+
+    py::dict frame_ring_stats() const {
+        py::dict result;
+        if (ring) {
+            result["frames"] = uint64_t(ring->frames);
+            result["frames_skipped"] = uint64_t(ring->frames_skipped);
+        }
+        return result;
+    }
+
+    void play_video(int fd, piomatter::video_format format, double fps,
+                    bool drop_late, bool loop, piomatter::yuv_matrix matrix,
+                    bool full_range) {
+        video.reset();
+        video = std::make_unique<piomatter::video_input>(
+            *matter, fd, width, height, format, fps, drop_late, loop,
+            piomatter::yuv_encoding{matrix, full_range});
+    }
+
+    void stop_video() { video.reset(); }
+
+    bool wait_video(std::optional<double> timeout) {
+        if (!video) {
+            return true;
+        }
+        bool ended;
+        {
+            py::gil_scoped_release release;
+            ended = video->wait(timeout.value_or(24 * 365 * 3600.));
+        }
+        if (ended && !video->error().empty()) {
+            throw std::runtime_error(video->error());
+        }
+        return ended;
+    }
+
+    py::dict video_stats() const {
+        py::dict result;
+        if (video) {
+            result["frames"] = uint64_t(video->frames);
+            result["frames_late"] = uint64_t(video->frames_late);
+            result["frames_dropped"] = uint64_t(video->frames_dropped);
+        }
+        return result;
+    }
+
+    py::dict ddp_stats() const {
+        py::dict result;
+        if (receiver) {
+            result["packets"] = uint64_t(receiver->packets);
+            result["packets_ignored"] = uint64_t(receiver->packets_ignored);
+            result["packets_lost"] = uint64_t(receiver->packets_lost);
+            result["frames"] = uint64_t(receiver->frames);
+            result["last_latency_ns"] = uint64_t(receiver->last_latency);
+            result["max_latency_ns"] = uint64_t(receiver->max_latency);
+        }
+        return result;
+    }
+
+    // buffers registered for show(index), kept alive along with their views
+    std::vector<py::buffer> registered;
+    std::vector<byte_view> registered_views;
+
+    uint64_t show(std::optional<std::variant<size_t, py::buffer>> source,
+                  uint64_t present_at) {
+        if (!source) {
+            return matter->show(present_at);
+        } else if (auto *index = std::get_if<size_t>(&*source)) {
+            return matter->show(registered_views.at(*index), present_at);
+        } else {
+            return matter->show(
+                make_view(std::get<py::buffer>(*source), false), present_at);
+        }
+    }
+
+    using byte_array =
+        py::array_t<uint8_t, py::array::c_style | py::array::forcecast>;
+
+    uint64_t show_yuv(byte_array frame, bool nv12, piomatter::yuv_matrix matrix,
+                      bool full_range, uint64_t present_at) {
+        size_t size = piomatter::yuv_frame::size_in_bytes(width, height);
+        if (size_t(frame.size()) != size) {
+            throw std::runtime_error(
+                py::str("YUV frame must be {} bytes, got {}")
+                    .attr("format")(size, frame.size())
+                    .cast<std::string>());
+        }
+        auto yuv =
+            nv12 ? piomatter::yuv_frame::nv12(frame.data(), width, height)
+                 : piomatter::yuv_frame::i420(frame.data(), width, height);
+        return matter->show_yuv(yuv, {matrix, full_range}, present_at);
+    }
+
+    // A future for each event fd waited on, shared by all its awaiters, and
+    // the event loop watching the fd for it
+    struct event_waiter {
+        py::object loop, future;
+    };
+    std::map<int, event_waiter> waiters;
+
+    ~PyPiomatter() {
+        for (auto &[fd, waiter] : waiters) {
+            try {
+                if (waiter.future &&
+                    !waiter.future.attr("done")().cast<bool>()) {
+                    waiter.loop.attr("remove_reader")(fd);
+                    waiter.future.attr("cancel")();
+                }
+            } catch (const py::error_already_set &) {
+                // the loop has been closed, and watches nothing anymore
+            }
+        }
+    }
+
+    static void drain_event(int fd) {
+        uint64_t count;
+        [[maybe_unused]] auto r = read(fd, &count, sizeof(count));
+    }
+
+    // An asyncio future that completes when `fd` is next signaled, or at
+    // once if `ready` says the condition awaited already holds
+    py::object wait_event(int fd, const std::function<bool()> &ready = {}) {
+        auto loop = py::module_::import("asyncio").attr("get_running_loop")();
+        auto &waiter = waiters[fd];
+        const bool pending = waiter.future &&
+                             !waiter.future.attr("done")().cast<bool>() &&
+                             waiter.loop.is(loop);
+        if (!pending) {
+            // only events after this call count; a pending waiter has
+            // already done this, and draining again could swallow its event
+            drain_event(fd);
+        }
+        if (ready && ready()) {
+            auto future = loop.attr("create_future")();
+            future.attr("set_result")(py::none());
+            return future;
+        }
+        if (pending) {
+            return waiter.future;
+        }
+        auto future = loop.attr("create_future")();
+        loop.attr("add_reader")(fd, py::cpp_function([loop, future, fd]() {
+                                    loop.attr("remove_reader")(fd);
+                                    drain_event(fd);
+                                    if (!future.attr("done")().cast<bool>()) {
+                                        future.attr("set_result")(py::none());
+                                    }
+                                }));
+        waiter = {loop, future};
+        return future;
+    }
+
+    py::object wait_buffer_available() {
+        return wait_event(matter->buffer_available_fd,
+                          [this] { return matter->buffer_available(); });
+    }
+
+    py::object wait_presented() {
+        return wait_event(matter->presented_fd);
+    }
+
+    int buffer_available_fd() const { return matter->buffer_available_fd; }
+    int presented_fd() const { return matter->presented_fd; }
+
+    std::pair<uint64_t, uint64_t> last_presented() const {
+        auto presented = matter->last_presented();
+        return {presented.sequence, presented.time};
+    }
+
+    void register_buffers(const std::vector<py::buffer> &buffers) {
+        std::vector<byte_view> views;
+        for (const auto &b : buffers) {
+            views.push_back(make_view(b, false));
+        }
+        registered = buffers;
+        registered_views = std::move(views);
+    }
+    void play(const std::vector<py::buffer> &frames,
+              const durations_arg &durations, bool loop) {
+        std::vector<byte_view> views;
+        for (const auto &f : frames) {
+            views.push_back(make_view(f, false));
+        }
+        auto frame_durations = expand_durations(durations, views.size());
+        // these would replace the animation as soon as it started
+        stop_mirror();
+        end_scroll();
+        stop_ddp();
+        stop_frame_ring();
+        stop_video();
+        matter->play(views, frame_durations, loop);
+    }
+
+    void play_file(const std::string &path, bool loop) {
+        auto file = std::make_shared<piomatter::stream_file>(path);
+        stop_mirror();
+        end_scroll();
+        stop_ddp();
+        stop_frame_ring();
+        stop_video();
+        matter->play(std::move(file), loop);
+    }
+
+    void stop_animation() { matter->stop_animation(); }
 
-    void show() { matter->show(); }
     double fps() const { return matter->fps; }
+    double pwm_frequency() const { return matter->pwm_frequency; }
+
+    double brightness = 1.0;
+    std::vector<double> row_brightness;
+
+    void set_brightness(double value) {
+        if (value < 0 || value > 1) {
+            throw std::range_error("brightness must be from 0 to 1");
+        }
+        matter->set_brightness(value, row_brightness);
+        brightness = value;
+    }
+
+    void set_row_brightness(const std::vector<double> &value) {
+        for (auto v : value) {
+            if (v < 0 || v > 1) {
+                throw std::range_error("row brightness must be from 0 to 1");
+            }
+        }
+        matter->set_brightness(brightness, value);
+        row_brightness = value;
+    }
+
+    void set_calibration(
+        std::variant<double, std::array<double, 3>> gamma,
+        std::optional<std::array<std::array<double, 3>, 3>> matrix,
+        std::optional<std::array<double, 3>> white_balance,
+        std::optional<std::pair<size_t, size_t>> panel_size,
+        const std::vector<std::array<double, 3>> &panel_gains) {
+        piomatter::color_calibration calibration;
+        if (auto *g = std::get_if<double>(&gamma)) {
+            calibration.gamma = {*g, *g, *g};
+        } else {
+            calibration.gamma = std::get<std::array<double, 3>>(gamma);
+        }
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                double m = matrix ? (*matrix)[i][j] : i == j;
+                calibration.matrix[i * 3 + j] =
+                    m * (white_balance ? (*white_balance)[i] : 1);
+            }
+        }
+        if (!panel_gains.empty()) {
+            if (!panel_size || !panel_size->first || !panel_size->second) {
+                throw std::runtime_error(
+                    "panel_size is required with panel_gains");
+            }
+            calibration.panel_width = panel_size->first;
+            calibration.panel_height = panel_size->second;
+            calibration.panel_gains = panel_gains;
+        }
+        matter->set_calibration(calibration);
+    }
 };
 
-template <typename pinout, typename colorspace>
-std::unique_ptr<PyPiomatter>
-make_piomatter_pc(py::buffer buffer,
-                  const piomatter::matrix_geometry &geometry) {
-    using cls = piomatter::piomatter<pinout, colorspace>;
+piomatter::matrix_geometry make_geometry(size_t width, size_t height,
+                                         size_t n_addr_lines, bool serpentine,
+                                         piomatter::orientation rotation,
+                                         size_t n_planes) {
+    size_t n_lines = 2 << n_addr_lines;
+    size_t pixels_across = width * height / n_lines;
+    size_t odd = (width * height) % n_lines;
+    if (odd) {
+        throw std::runtime_error(
+            py::str("Total pixel count {} must be a multiple of {}, "
+                    "the number of distinct row addresses for {}")
+                .attr("format")(width * height, n_lines, n_addr_lines)
+                .cast<std::string>());
+    }
+    switch (rotation) {
+    case piomatter::orientation::normal:
+        return piomatter::matrix_geometry(pixels_across, n_addr_lines,
+                                          n_planes, width, height, serpentine,
+                                          piomatter::orientation_normal);
+
+    case piomatter::orientation::r180:
+        return piomatter::matrix_geometry(pixels_across, n_addr_lines,
+                                          n_planes, width, height, serpentine,
+                                          piomatter::orientation_r180);
+
+    case piomatter::orientation::ccw:
+        return piomatter::matrix_geometry(pixels_across, n_addr_lines,
+                                          n_planes, width, height, serpentine,
+                                          piomatter::orientation_ccw);
+
+    case piomatter::orientation::cw:
+        return piomatter::matrix_geometry(pixels_across, n_addr_lines,
+                                          n_planes, width, height, serpentine,
+                                          piomatter::orientation_cw);
+    }
+    throw std::runtime_error("invalid rotation");
+}
+
+using map_array = py::array_t<int, py::array::c_style | py::array::forcecast>;
+
+piomatter::matrix_geometry make_custom_geometry(
+    size_t width, size_t height, size_t n_addr_lines, size_t n_planes,
+    const std::optional<std::vector<piomatter::panel_placement>> &panels,
+    const std::optional<map_array> &map) {
+    size_t n_lines = 2 << n_addr_lines;
+    piomatter::matrix_map result;
+    if (panels) {
+        if (map) {
+            throw std::runtime_error("Only one of panels and map may be given");
+        }
+        result = piomatter::make_layout_matrixmap(width, height, n_addr_lines,
+                                                  *panels);
+    } else {
+        result.assign(map->data(), map->data() + map->size());
+        if (result.size() % n_lines) {
+            throw std::runtime_error(
+                py::str("Map size {} must be a multiple of {}, "
+                        "the number of distinct row addresses for {}")
+                    .attr("format")(result.size(), n_lines, n_addr_lines)
+                    .cast<std::string>());
+        }
+    }
+    size_t pixels_across = result.size() / n_lines;
+    return piomatter::matrix_geometry(pixels_across, n_addr_lines, n_planes,
+                                      width, height, std::move(result));
+}
+
+bool is_c_contiguous(const py::buffer_info &info) {
+    ssize_t stride = info.itemsize;
+    for (ssize_t i = info.ndim; i-- > 0;) {
+        if (info.shape[i] != 1 && info.strides[i] != stride) {
+            return false;
+        }
+        stride *= info.shape[i];
+    }
+    return true;
+}
+
+// View a buffer as the framebuffer for `geometry`. A contiguous buffer of the
+// right size can have any shape; otherwise it must be a (height, width) array
+// of pixels, or (height, width, 3) for packed RGB888, with any strides. Both
+// dimensions may also be the same integer multiple of the geometry, in which
+// case the converter scales it down. A canvas may have any size at least as
+// large as the geometry.
+template <typename colorspace>
+piomatter::framebuffer_view<typename colorspace::data_type>
+make_framebuffer_view(const py::buffer &buffer, size_t width, size_t height,
+                      bool canvas = false) {
     using data_type = colorspace::data_type;
 
-    const auto n_pixels = geometry.width * geometry.height;
+    const auto n_pixels = width * height;
     const auto data_size_in_bytes = colorspace::data_size_in_bytes(n_pixels);
+    const auto pixel_size = colorspace::data_size_in_bytes(1);
     const py::buffer_info info = buffer.request();
     const size_t buffer_size_in_bytes = info.size * info.itemsize;
+    const auto data = reinterpret_cast<const data_type *>(info.ptr);
 
-    if (buffer_size_in_bytes != data_size_in_bytes) {
+    if (!canvas && buffer_size_in_bytes == data_size_in_bytes &&
+        is_c_contiguous(info)) {
+        return {std::span(data, data_size_in_bytes / sizeof(data_type)), width,
+                pixel_size};
+    }
+
+    const ssize_t pixel_ndim = pixel_size == sizeof(data_type) ? 2 : 3;
+    const bool pixel_array =
+        info.ndim == pixel_ndim && info.itemsize == sizeof(data_type) &&
+        (pixel_ndim == 2 ||
+         (size_t(info.shape[2]) * sizeof(data_type) == pixel_size &&
+          info.strides[2] == info.itemsize));
+    if (canvas) {
+        if (pixel_array && size_t(info.shape[0]) >= height &&
+            size_t(info.shape[1]) >= width) {
+            return {data, size_t(info.shape[1]), size_t(info.shape[0]),
+                    info.strides[0], info.strides[1]};
+        }
         throw std::runtime_error(
-            py::str("Framebuffer size must be {} bytes ({} elements of {} "
-                    "bytes each), got a buffer of {} bytes")
-                .attr("format")(data_size_in_bytes, n_pixels,
-                                colorspace::data_size_in_bytes(1),
-                                buffer_size_in_bytes)
+            py::str("Canvas must have shape (rows, columns{}) with at least "
+                    "{} rows and {} columns, and items of {} bytes")
+                .attr("format")(pixel_size == sizeof(data_type) ? "" : ", 3",
+                                height, width, sizeof(data_type))
                 .template cast<std::string>());
     }
 
-    std::span<data_type> framebuffer(reinterpret_cast<data_type *>(info.ptr),
-                                     data_size_in_bytes / sizeof(data_type));
+    if (pixel_array && height) {
+        const size_t scale = info.shape[0] / height;
+        if (scale && size_t(info.shape[0]) == height * scale &&
+            size_t(info.shape[1]) == width * scale) {
+            return {data, width * scale, height * scale, info.strides[0],
+                    info.strides[1]};
+        }
+    }
+
+    throw std::runtime_error(
+        py::str("Framebuffer size must be {} bytes ({} elements of {} "
+                "bytes each), got a buffer of {} bytes. A strided or scaled "
+                "framebuffer must have shape ({}, {}{}), or a multiple of it, "
+                "with items of {} bytes")
+            .attr("format")(data_size_in_bytes, n_pixels, pixel_size,
+                            buffer_size_in_bytes, height, width,
+                            pixel_size == sizeof(data_type) ? "" : ", 3",
+                            sizeof(data_type))
+            .template cast<std::string>());
+}
+
+template <typename pinout, typename colorspace>
+std::unique_ptr<PyPiomatter>
+make_piomatter_pc(py::buffer buffer,
+                  const piomatter::matrix_geometry &geometry) {
+    using cls = piomatter::piomatter<pinout, colorspace>;
+
+    auto make_view = [width = geometry.width, height = geometry.height](
+                         const py::buffer &b, bool canvas) {
+        return make_framebuffer_view<colorspace>(b, width, height, canvas)
+            .template as<uint8_t>();
+    };
+    auto framebuffer =
+        make_framebuffer_view<colorspace>(buffer, geometry.width,
+                                          geometry.height);
     return std::make_unique<PyPiomatter>(
-        buffer, std::move(std::make_unique<cls>(framebuffer, geometry)));
+        buffer, std::move(std::make_unique<cls>(framebuffer, geometry)),
+        make_view, geometry.width, geometry.height,
+        colorspace::data_size_in_bytes(1));
+}
+
+// The producer's end of a frame ring served by a PioMatter, usually in
+// another process
+struct PyFrameRingProducer {
+    explicit PyFrameRingProducer(const std::string &name) : producer{name} {}
+    piomatter::shm_ring_producer producer;
+
+    // The slot for the next frame as an array shaped like the framebuffer,
+    // or None if it isn't free before the timeout
+    py::object next_frame(std::optional<double> timeout) {
+        uint8_t *slot;
+        {
+            py::gil_scoped_release release;
+            auto wait = timeout ? std::chrono::duration<double>(*timeout)
+                                : std::chrono::hours(24 * 365);
+            slot = producer.next_frame(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(wait));
+        }
+        if (!slot) {
+            return py::none();
+        }
+        // the array keeps this, and so the mapping, alive
+        auto self = py::cast(this, py::return_value_policy::reference);
+        ssize_t height = producer.height, width = producer.width;
+        switch (producer.pixel_size) {
+        case 2:
+            return py::array_t<uint16_t>({height, width},
+                                         reinterpret_cast<uint16_t *>(slot),
+                                         self);
+        case 3:
+            return py::array_t<uint8_t>({height, width, 3}, slot, self);
+        default:
+            return py::array_t<uint32_t>({height, width},
+                                         reinterpret_cast<uint32_t *>(slot),
+                                         self);
+        }
+    }
+
+    void publish() { producer.publish(); }
+};
+
+template <typename pinout, typename colorspace>
+void render_stream_file_pc(const std::string &path,
+                           const piomatter::matrix_geometry &geometry,
+                           const std::vector<py::buffer> &frames,
+                           const durations_arg &durations) {
+    std::vector<piomatter::framebuffer_view<typename colorspace::data_type>>
+        views;
+    for (const auto &f : frames) {
+        views.push_back(
+            make_framebuffer_view<colorspace>(f, geometry.width,
+                                              geometry.height));
+    }
+    piomatter::write_stream_file<pinout, colorspace>(
+        path, geometry, views, expand_durations(durations, views.size()));
 }
 
 enum Colorspace { RGB565, RGB888, RGB888Packed };
@@ -78,6 +652,49 @@ make_piomatter_p(Colorspace c, py::buffer buffer,
     }
 }
 
+template <class pinout>
+void render_stream_file_p(Colorspace c, const std::string &path,
+                          const piomatter::matrix_geometry &geometry,
+                          const std::vector<py::buffer> &frames,
+                          const durations_arg &durations) {
+    switch (c) {
+    case RGB565:
+        return render_stream_file_pc<pinout, piomatter::colorspace_rgb565>(
+            path, geometry, frames, durations);
+    case RGB888:
+        return render_stream_file_pc<pinout, piomatter::colorspace_rgb888>(
+            path, geometry, frames, durations);
+    case RGB888Packed:
+        return render_stream_file_pc<pinout,
+                                     piomatter::colorspace_rgb888_packed>(
+            path, geometry, frames, durations);
+
+    default:
+        throw std::runtime_error(py::str("Invalid colorspace {!r}")
+                                     .attr("format")(c)
+                                     .template cast<std::string>());
+    }
+}
+
+void render_stream_file(const std::string &path, Colorspace c, Pinout p,
+                        const piomatter::matrix_geometry &geometry,
+                        const std::vector<py::buffer> &frames,
+                        const durations_arg &durations) {
+    switch (p) {
+    case AdafruitMatrixBonnet:
+        return render_stream_file_p<piomatter::adafruit_matrix_bonnet_pinout>(
+            c, path, geometry, frames, durations);
+    case AdafruitMatrixBonnetBGR:
+        return render_stream_file_p<
+            piomatter::adafruit_matrix_bonnet_pinout_bgr>(c, path, geometry,
+                                                          frames, durations);
+    default:
+        throw std::runtime_error(py::str("Invalid pinout {!r}")
+                                     .attr("format")(p)
+                                     .template cast<std::string>());
+    }
+}
+
 std::unique_ptr<PyPiomatter>
 make_piomatter(Colorspace c, Pinout p, py::buffer buffer,
                const piomatter::matrix_geometry &geometry) {
@@ -112,6 +729,8 @@ PYBIND11_MODULE(adafruit_blinka_raspberry_pi5_piomatter, m) {
            :toctree: _generate
 
            Orientation
+           ScanOrder
+           Dither
            Pinout
            Colorspace
            Geometry
@@ -129,6 +748,25 @@ PYBIND11_MODULE(adafruit_blinka_raspberry_pi5_piomatter, m) {
         .value("CW", piomatter::orientation::cw,
                "Rotated 90 degress clockwise");
 
+    py::enum_<piomatter::scan_order>(
+        m, "ScanOrder", "Describe the order in which address rows are scanned")
+        .value("Linear", piomatter::scan_order::linear,
+               "Scan rows from top to bottom")
+        .value("Interlaced", piomatter::scan_order::interlaced,
+               "Scan even rows, then odd rows")
+        .value("BitReversed", piomatter::scan_order::bit_reversed,
+               "Scan rows in bit-reversed order, so that consecutive rows are "
+               "far apart");
+
+    py::enum_<piomatter::dither_mode>(
+        m, "Dither", "Describe the spatial dithering applied to converted pixels")
+        .value("Disabled", piomatter::dither_mode::no_dither,
+               "Drop the bits that are not displayed")
+        .value("Bayer", piomatter::dither_mode::bayer,
+               "Ordered dithering with an 8x8 Bayer matrix")
+        .value("BlueNoise", piomatter::dither_mode::blue_noise,
+               "Ordered dithering with a 16x16 blue noise matrix");
+
     py::enum_<Pinout>(
         m, "Pinout", "Describes the pins used for the connection to the matrix")
         .value("AdafruitMatrixBonnet", Pinout::AdafruitMatrixBonnet,
@@ -148,6 +786,51 @@ PYBIND11_MODULE(adafruit_blinka_raspberry_pi5_piomatter, m) {
         .value("RGB888", Colorspace::RGB888, "4 bytes per pixel in RGB order")
         .value("RGB565", Colorspace::RGB565, "2 bytes per pixel in RGB order");
 
+    py::enum_<piomatter::video_format>(
+        m, "VideoFormat", "Uncompressed video formats read by play_video()")
+        .value("RGB888Packed", piomatter::video_format::rgb888_packed,
+               "Raw frames of 3 bytes per pixel in RGB order")
+        .value("RGB565", piomatter::video_format::rgb565,
+               "Raw frames of 2 bytes per pixel in RGB order")
+        .value("Y4M", piomatter::video_format::y4m,
+               "A YUV4MPEG2 stream with 4:2:0 chroma")
+        .value("I420", piomatter::video_format::i420,
+               "Raw frames of Y, U and V planes, with 4:2:0 chroma")
+        .value("NV12", piomatter::video_format::nv12,
+               "Raw frames of a Y plane and an interleaved UV plane, with "
+               "4:2:0 chroma");
+
+    py::enum_<piomatter::yuv_matrix>(
+        m, "YUVMatrix", "The standard by which YUV values encode RGB")
+        .value("BT601", piomatter::yuv_matrix::bt601,
+               "ITU-R BT.601, for standard definition video")
+        .value("BT709", piomatter::yuv_matrix::bt709,
+               "ITU-R BT.709, for high definition video");
+
+    py::class_<piomatter::panel_placement>(m, "Panel", R"pbdoc(
+Describe where one panel of a chain is mounted
+
+``x`` and ``y`` give the top left corner of the area covered by the panel on
+the canvas, after rotation.
+
+``width`` is the width of the panel in pixels. Its height follows from the
+number of address lines of the ``Geometry``.
+
+``rotation`` is how the panel is mounted, and must be one of the ``Orientation``
+constants. A panel rotated by ``CW`` or ``CCW`` covers an area that is
+``width`` pixels tall.
+)pbdoc")
+        .def(py::init([](int x, int y, size_t width,
+                         piomatter::orientation rotation) {
+                 return piomatter::panel_placement{x, y, width, rotation};
+             }),
+             py::arg("x"), py::arg("y"), py::arg("width"),
+             py::arg("rotation") = piomatter::orientation::normal)
+        .def_readonly("x", &piomatter::panel_placement::x)
+        .def_readonly("y", &piomatter::panel_placement::y)
+        .def_readonly("width", &piomatter::panel_placement::width)
+        .def_readonly("rotation", &piomatter::panel_placement::rotation);
+
     py::class_<piomatter::matrix_geometry>(m, "Geometry", R"pbdoc(
 Describe the geometry of a set of panels
 
@@ -166,49 +849,87 @@ constants. Default is ``Orientation.Normal``.
 ``n_planes`` controls the color depth of the panel. This is separate from the framebuffer
 layout. Decreasing ``n_planes`` can increase FPS at the cost of reduced color fidelity.
 The default, 10, is the maximum value.
+
+``plane_spread`` splits the longest bit planes into ``2**plane_spread`` shorter
+/OE pulses which are spread over as many scans of the panel, keeping the total
+on-time of each plane the same. This raises the effective PWM frequency, which
+reduces banding when the panel is filmed and flicker at low refresh rates, at
+the cost of more data per refresh and therefore a lower ``fps``. The default, 0,
+shows each row's planes in one contiguous block.
+
+``n_temporal_planes`` adds temporal dithering: each frame is shown as
+``2**n_temporal_planes`` refreshes with ``n_planes`` planes each, which round the
+lower bits differently so that on average ``n_planes + n_temporal_planes`` bits of
+depth are shown. For instance, ``n_planes=6, n_temporal_planes=4`` gives close to
+full color depth at nearly the refresh rate of 6 planes. The refreshes are
+rendered once, when ``show()`` is called. The default, 0, disables dithering.
+
+``dither`` selects spatial dithering, which must be one of the ``Dither`` constants.
+When fewer than 10 planes are displayed, each converted pixel has a threshold from
+a fixed pattern added before its low bits are dropped, which turns the bands in
+smooth gradients into a fine pattern. This allows using 5 or 6 planes for higher
+refresh rates with fewer visible artifacts. The default is ``Dither.Disabled``.
+
+``scan_order`` controls the order in which the address rows are scanned. It may be
+one of the ``ScanOrder`` constants, or a list giving each row address exactly once.
+Scanning rows out of order can hide the rolling "wave" visible at low refresh
+rates without sending any more data.
+
+``panels`` describes an arbitrary arrangement of panels as a list of ``Panel``
+instances, in the order they are chained. ``width`` and ``height`` are then the
+size of the canvas the panels are placed on, and ``serpentine`` and ``rotation``
+are not used. Canvas pixels not covered by any panel are not displayed.
+
+``map`` gives the mapping from the shift register to the framebuffer directly,
+as a sequence or numpy array of framebuffer indices. For each row address in
+turn, and for each pixel of the shift register, it holds the index of the pixel
+in the top half of the panels followed by the index of the pixel in the bottom
+half. Its length must be a multiple of ``2 << n_addr_lines``. Only one of
+``panels`` and ``map`` may be given.
 )pbdoc")
         .def(py::init([](size_t width, size_t height, size_t n_addr_lines,
                          bool serpentine, piomatter::orientation rotation,
-                         size_t n_planes) {
-                 size_t n_lines = 2 << n_addr_lines;
-                 size_t pixels_across = width * height / n_lines;
-                 size_t odd = (width * height) % n_lines;
-                 if (odd) {
-                     throw std::runtime_error(
-                         py::str(
-                             "Total pixel count {} must be a multiple of {}, "
-                             "the number of distinct row addresses for {}")
-                             .attr("format")(width * height, n_lines,
-                                             n_addr_lines)
-                             .cast<std::string>());
+                         size_t n_planes, int plane_spread,
+                         int n_temporal_planes, piomatter::dither_mode dither,
+                         std::variant<piomatter::scan_order,
+                                      std::vector<size_t>>
+                             scan_order,
+                         std::optional<std::vector<piomatter::panel_placement>>
+                             panels,
+                         std::optional<map_array> map) {
+                 auto geometry =
+                     panels || map
+                         ? make_custom_geometry(width, height, n_addr_lines,
+                                                n_planes, panels, map)
+                         : make_geometry(width, height, n_addr_lines,
+                                         serpentine, rotation, n_planes);
+                 if (n_planes + n_temporal_planes > 10) {
+                     throw std::range_error(
+                         "n_planes + n_temporal_planes must be at most 10");
                  }
-                 switch (rotation) {
-                 case piomatter::orientation::normal:
-                     return piomatter::matrix_geometry(
-                         pixels_across, n_addr_lines, n_planes, width, height,
-                         serpentine, piomatter::orientation_normal);
-
-                 case piomatter::orientation::r180:
-                     return piomatter::matrix_geometry(
-                         pixels_across, n_addr_lines, n_planes, width, height,
-                         serpentine, piomatter::orientation_r180);
-
-                 case piomatter::orientation::ccw:
-                     return piomatter::matrix_geometry(
-                         pixels_across, n_addr_lines, n_planes, width, height,
-                         serpentine, piomatter::orientation_ccw);
-
-                 case piomatter::orientation::cw:
-                     return piomatter::matrix_geometry(
-                         pixels_across, n_addr_lines, n_planes, width, height,
-                         serpentine, piomatter::orientation_cw);
+                 geometry.plane_spread = plane_spread;
+                 geometry.n_temporal_planes = n_temporal_planes;
+                 geometry.dither = dither;
+                 if (auto *order =
+                         std::get_if<piomatter::scan_order>(&scan_order)) {
+                     geometry.addr_order =
+                         piomatter::make_addr_order(*order, n_addr_lines);
+                 } else {
+                     geometry.addr_order =
+                         std::get<std::vector<size_t>>(scan_order);
+                     piomatter::check_addr_order(geometry.addr_order,
+                                                 n_addr_lines);
                  }
-                 throw std::runtime_error("invalid rotation");
+                 return geometry;
              }),
              py::arg("width"), py::arg("height"), py::arg("n_addr_lines"),
              py::arg("serpentine") = true,
              py::arg("rotation") = piomatter::orientation::normal,
-             py::arg("n_planes") = 10u)
+             py::arg("n_planes") = 10u, py::arg("plane_spread") = 0,
+             py::arg("n_temporal_planes") = 0,
+             py::arg("dither") = piomatter::dither_mode::no_dither,
+             py::arg("scan_order") = piomatter::scan_order::linear,
+             py::arg("panels") = py::none(), py::arg("map") = py::none())
         .def_readonly("width", &piomatter::matrix_geometry::width)
         .def_readonly("height", &piomatter::matrix_geometry::height);
 
@@ -224,21 +945,386 @@ support different hardware breakouts and panels with different color order. The
 value must be one of the ``Pinout`` constants.
 
 ``framebuffer`` a numpy array that holds pixel data in the appropriate colorspace.
+It may also be a view into a larger array, such as a slice of a bigger canvas or of a
+memory-mapped framebuffer device, as long as its shape is ``(height, width)``, or
+``(height, width, 3)`` for ``RGB888Packed``. Its strides are honored, so no copy is
+made. Both dimensions may also be the same integer multiple of the geometry; each
+block of pixels is then averaged into one, in linear light, as part of conversion.
 
 ``geometry`` controls the size and shape of the panel. The value must be a ``Geometry``
 instance.
 )pbdoc")
         .def(py::init(&make_piomatter), py::arg("colorspace"),
              py::arg("pinout"), py::arg("framebuffer"), py::arg("geometry"))
-        .def("show", &PyPiomatter::show, R"pbdoc(
+        .def("show", &PyPiomatter::show, py::arg("source") = py::none(),
+             py::arg("present_at") = 0, R"pbdoc(
 Update the displayed image
 
 After modifying the content of the framebuffer, call this method to
 update the data actually displayed on the panel. Internally, the
 data is triple-buffered to prevent tearing.
+
+``source`` optionally selects different pixel data to display instead of the
+framebuffer: either another buffer with the same shape and colorspace, or the
+index of a buffer passed to ``register_buffers``. The data is only read while
+``show()`` runs, so the buffer may be drawn into again as soon as it returns.
+
+``present_at`` optionally schedules the frame: it is a time in nanoseconds on
+the clock of ``time.monotonic_ns()``, and the frame replaces the one on display
+at the first refresh that starts after that time. Frames are presented in the
+order they are shown. Up to two frames can wait for their time; showing more
+blocks until one has been presented.
+
+Returns the frame's sequence number, to match with ``last_presented``.
+)pbdoc")
+        .def("show_yuv", &PyPiomatter::show_yuv, py::arg("frame"),
+             py::arg("nv12") = false,
+             py::arg("matrix") = piomatter::yuv_matrix::bt601,
+             py::arg("full_range") = false, py::arg("present_at") = 0,
+             R"pbdoc(
+Show a frame of YUV video with 4:2:0 chroma, such as a decoded video frame
+
+``frame`` holds the Y plane of the display's size followed by the U and V
+planes of half its width and height, rounded up, as in I420 (``yuv420p``), or
+with ``nv12=True`` by a single plane of interleaved U and V as in NV12. ``matrix``
+is a ``YUVMatrix`` constant, and ``full_range`` tells whether luma spans 0 to
+255 rather than 16 to 235.
+
+The YUV to RGB conversion, chroma upsampling, gamma and calibration are done
+together in one pass that produces the data to render, without an intermediate
+RGB frame. ``present_at`` and the return value are as for ``show()``.
+)pbdoc")
+        .def("wait_buffer_available", &PyPiomatter::wait_buffer_available,
+             R"pbdoc(
+Wait, in asyncio, until ``show()`` can run without blocking
+
+Returns an awaitable that completes at once if a buffer is free, and otherwise
+as soon as the blitter frees one. Must be called from a running event loop.
+)pbdoc")
+        .def("wait_presented", &PyPiomatter::wait_presented, R"pbdoc(
+Wait, in asyncio, until the next frame is presented
+
+Returns an awaitable that completes when the blitter next starts sending a new
+frame to the display; ``last_presented`` then says which frame it was and when.
+Must be called from a running event loop.
+)pbdoc")
+        .def_property_readonly("buffer_available_fd",
+                               &PyPiomatter::buffer_available_fd, R"pbdoc(
+An event fd that becomes readable when the blitter frees a buffer
+
+For use with ``select`` or another event loop; reading it resets it. This is
+the fd that ``wait_buffer_available()`` watches, so don't mix the two.
+)pbdoc")
+        .def_property_readonly("presented_fd", &PyPiomatter::presented_fd,
+                               R"pbdoc(
+An event fd that becomes readable when the blitter presents a new frame
+
+For use with ``select`` or another event loop; reading it resets it. This is
+the fd that ``wait_presented()`` watches, so don't mix the two.
+)pbdoc")
+        .def_property_readonly("last_presented", &PyPiomatter::last_presented,
+                               R"pbdoc(
+The sequence number of the frame on display and when it was presented
+
+The time is in nanoseconds on the clock of ``time.monotonic_ns()``, taken as
+the blitter starts sending the frame to the display. Comparing it with the
+``present_at`` time that was requested shows how far presentation lags, so that
+a producer can correct for drift.
+)pbdoc")
+        .def("mirror_framebuffer", &PyPiomatter::mirror_framebuffer,
+             py::arg("device") = "/dev/fb0", py::arg("x_offset") = 0,
+             py::arg("y_offset") = 0, py::arg("scale") = 1,
+             py::arg("rate") = 60.0, R"pbdoc(
+Continuously mirror a region of a Linux framebuffer device
+
+A thread started by this method maps ``device`` and checks it ``rate`` times
+per second. The region mirrored starts at ``x_offset``, ``y_offset`` and covers
+``scale`` times the matrix size; each block of ``scale`` by ``scale`` pixels is
+averaged into one. The image is only converted and rendered again when a row
+of the region changed, so mirroring a mostly static screen costs very little.
+Python is not involved once mirroring has started.
+
+The framebuffer must be RGB565 when the colorspace is ``RGB565``, or XRGB8888
+when it is ``RGB888``. Mirroring replaces any previous mirroring, and runs until
+``stop_mirror()`` is called or the object is deleted.
+)pbdoc")
+        .def("stop_mirror", &PyPiomatter::stop_mirror, R"pbdoc(
+Stop mirroring started by ``mirror_framebuffer()``
+)pbdoc")
+        .def("set_canvas", &PyPiomatter::set_canvas, py::arg("canvas"),
+             R"pbdoc(
+Set a virtual canvas larger than the display
+
+``canvas`` is an array in the framebuffer's colorspace with at least as many
+rows and columns as the display, such as a long strip of text. It is converted
+once, here; call this again after changing its content. The part of the canvas
+shown is selected by ``viewport``, and moving the viewport only renders the
+already converted data again, so scrolling is cheap.
+)pbdoc")
+        .def_property("viewport", &PyPiomatter::viewport,
+                      &PyPiomatter::set_viewport, R"pbdoc(
+The position of the top left corner of the display on the canvas
+
+Setting it shows that part of the canvas set by ``set_canvas()``, and stops any
+scrolling.
+)pbdoc")
+        .def("scroll", &PyPiomatter::scroll, py::arg("dx"), py::arg("dy") = 0.0,
+             R"pbdoc(
+Scroll the viewport across the canvas
+
+The viewport moves by ``dx`` and ``dy`` pixels per second, one pixel at a
+time, from a native thread; Python is not involved while it scrolls. When it
+reaches the edge of the canvas it wraps around to the other side. Scrolling
+continues until ``stop_scroll()`` is called or ``viewport`` is set.
+)pbdoc")
+        .def("stop_scroll", &PyPiomatter::stop_scroll, R"pbdoc(
+Stop scrolling started by ``scroll()``
+
+If scrolling had already stopped because a position could not be shown, this
+raises ``RuntimeError`` saying why.
+)pbdoc")
+        .def("receive_ddp", &PyPiomatter::receive_ddp,
+             py::arg("port") = piomatter::ddp_default_port,
+             py::arg("address") = "", R"pbdoc(
+Receive frames over the network with DDP (Distributed Display Protocol)
+
+A thread started by this method listens for DDP packets on UDP ``port`` of
+``address``, or of all interfaces, and puts their RGB data into a frame of
+packed RGB888 pixels the size of the display, at the byte offset each packet
+gives. A packet with the push flag shows the frame, converting and rendering it
+without involving Python. Query, status and configuration packets, and data for
+other devices, in other formats or outside the frame, are ignored.
+
+The thread runs until ``stop_ddp()`` is called or another receiver is started.
+Counters are reported by ``ddp_stats``.
+)pbdoc")
+        .def("stop_ddp", &PyPiomatter::stop_ddp, R"pbdoc(
+Stop receiving frames started by ``receive_ddp()``
+)pbdoc")
+        .def_property_readonly("ddp_stats", &PyPiomatter::ddp_stats, R"pbdoc(
+Counters of the DDP receiver, as a dict
+
+``packets`` and ``packets_ignored`` count the packets used and ignored,
+``packets_lost`` those missing according to the packets' sequence numbers, and
+``frames`` the frames shown. ``last_latency_ns`` and ``max_latency_ns`` are the
+times from receiving the first packet of a frame to having rendered it. The dict
+is empty while nothing is being received.
+)pbdoc")
+        .def("serve_frame_ring", &PyPiomatter::serve_frame_ring,
+             py::arg("name") = "/piomatter", py::arg("n_slots") = 3, R"pbdoc(
+Show frames written to shared memory by another process
+
+This creates a ring of ``n_slots`` framebuffers, each with the shape and
+colorspace of the framebuffer, in the POSIX shared memory object ``name``. A
+producer in another process, opening it with ``FrameRingProducer`` or from
+another language following the layout documented in ``shmring.h``, writes
+frames into it and rings a futex doorbell. A thread started by this method
+then shows each new frame straight from shared memory, without involving
+Python. When the producer is faster than the display, frames that are
+overtaken before they are shown are skipped.
+
+The ring is removed by ``stop_frame_ring()``, or when another is served.
+Counters are reported by ``frame_ring_stats``.
+)pbdoc")
+        .def("stop_frame_ring", &PyPiomatter::stop_frame_ring, R"pbdoc(
+Stop showing frames from the ring served by ``serve_frame_ring()``, and remove it
+)pbdoc")
+        .def_property_readonly("frame_ring_stats",
+                               &PyPiomatter::frame_ring_stats, R"pbdoc(
+Counters of the frame ring, as a dict
+
+``frames`` counts the frames shown, and ``frames_skipped`` those overtaken by
+newer frames before they could be shown. The dict is empty while no ring is
+being served.
+)pbdoc")
+        .def("play_video", &PyPiomatter::play_video, py::arg("fd"),
+             py::arg("format") = piomatter::video_format::y4m,
+             py::arg("fps") = 30, py::arg("drop_late") = false,
+             py::arg("loop") = false,
+             py::arg("yuv_matrix") = piomatter::yuv_matrix::bt601,
+             py::arg("full_range") = false, R"pbdoc(
+Show uncompressed video read from a file descriptor
+
+``fd`` is an open file or pipe, such as the ``stdout`` of an ``ffmpeg``
+subprocess writing ``-f yuv4mpegpipe -``, and ``format`` one of the
+``VideoFormat`` constants. Raw frames are packed pixels the size of the
+display, shown at ``fps`` frames per second; a YUV4MPEG2 stream must have the
+size of the display and is shown at the rate in its header.
+
+One thread started by this method reads each frame into one of two buffers
+while another converts the previous frame and queues it to be shown at its time,
+without involving Python. With ``drop_late=True``, a frame that is ready only
+once the next one is due is skipped, though never two in a row, so the video
+catches up after a stall. With ``loop=True``, a file is rewound when it ends.
+
+YUV frames are converted as by ``show_yuv()`` with ``yuv_matrix`` and
+``full_range``; a YUV4MPEG2 stream that declares its range overrides
+``full_range``.
+
+The video plays until it ends, ``stop_video()`` is called or another video is
+started. ``fd`` is not closed, and must stay open until then.
+)pbdoc")
+        .def("stop_video", &PyPiomatter::stop_video, R"pbdoc(
+Stop the video started by ``play_video()``
+)pbdoc")
+        .def("wait_video", &PyPiomatter::wait_video,
+             py::arg("timeout") = py::none(), R"pbdoc(
+Wait for the video started by ``play_video()`` to end
+
+Returns whether it has ended before ``timeout`` seconds, or waits without a limit
+if ``timeout`` is None. Raises ``RuntimeError`` if the video ended because of a
+read error or a malformed stream.
+)pbdoc")
+        .def_property_readonly("video_stats", &PyPiomatter::video_stats,
+                               R"pbdoc(
+Counters of the video started by ``play_video()``, as a dict
+
+``frames`` counts the frames shown, ``frames_late`` those that were ready only
+after their time, and ``frames_dropped`` the late frames skipped. The dict is
+empty while no video has been started.
+)pbdoc")
+        .def("play", &PyPiomatter::play, py::arg("frames"),
+             py::arg("durations"), py::arg("loop") = true, R"pbdoc(
+Play an animation without involving Python
+
+``frames`` is a sequence of buffers, each with the shape and colorspace of the
+framebuffer, such as a list of arrays or a single array with one more
+dimension. ``durations`` is how long to show each frame, in seconds: either one
+number for all frames, or a sequence with one number per frame.
+
+The frames are converted and rendered once, here, and then the blitter thread
+switches between them on its own timer. Frame changes happen between refreshes
+of the display and are timed from the start of the animation, so the average
+rate is exact; frames shorter than a refresh are skipped. The animation repeats
+until another frame is shown, or ``stop_animation()`` is called. With
+``loop=False`` it stays on the last frame instead.
+
+Playing an animation stops any mirroring, scrolling, receiving or serving of a
+frame ring.
+)pbdoc")
+        .def("play_file", &PyPiomatter::play_file, py::arg("path"),
+             py::arg("loop") = true, R"pbdoc(
+Play an animation from a file made by ``render_stream_file()``
+
+The file is mapped into memory and its streams are sent to the display as they
+are, so playback starts at once and costs almost no CPU time. It must have been
+rendered for the same pinout, and a geometry with the same panel wiring, bit
+planes, temporal dithering, plane spread and address order. Otherwise, it plays
+like ``play()``.
+)pbdoc")
+        .def("stop_animation", &PyPiomatter::stop_animation, R"pbdoc(
+Stop an animation started by ``play()``
+
+The display goes back to the last frame shown before it.
+)pbdoc")
+        .def("register_buffers", &PyPiomatter::register_buffers,
+             py::arg("buffers"), R"pbdoc(
+Register buffers to be shown by index
+
+``buffers`` is a list of buffers with the same shape and colorspace as the
+framebuffer. They are checked once here, and kept alive until the next call
+to ``register_buffers``, so that ``show(i)`` can display buffer ``i`` without
+validating it again.
 )pbdoc")
         .def_property_readonly("fps", &PyPiomatter::fps, R"pbdoc(
 The approximate number of matrix refreshes per second.
+)pbdoc")
+        .def_property_readonly("pwm_frequency", &PyPiomatter::pwm_frequency,
+                               R"pbdoc(
+The predicted effective PWM frequency in Hz, i.e., the number of times per
+second each row is scanned. Without ``plane_spread`` this is the same as the
+number of refreshes per second the PIO clock allows.
+)pbdoc")
+        .def_property("brightness",
+                      [](const PyPiomatter &self) { return self.brightness; },
+                      &PyPiomatter::set_brightness, R"pbdoc(
+Overall brightness, from 0 to 1
+
+Brightness scales the time each row is lit (the /OE on-time), so it keeps
+the full color resolution of the framebuffer and doesn't change the refresh
+rate. Setting it updates the already rendered data in place, so it takes
+effect immediately without a call to ``show()``. At low brightness, the on-time
+of the least significant planes becomes shorter than the PIO can resolve and
+they are rounded.
+)pbdoc")
+        .def_property("row_brightness",
+                      [](const PyPiomatter &self) {
+                          return self.row_brightness;
+                      },
+                      &PyPiomatter::set_row_brightness, R"pbdoc(
+Additional brightness for each address row, from 0 to 1
+
+A list giving a factor for each row address, multiplied with ``brightness``.
+Both halves of the panel that share an address get the same factor. Rows not
+in the list are not dimmed. Like ``brightness``, this updates the displayed data
+in place.
+)pbdoc")
+        .def("set_calibration", &PyPiomatter::set_calibration,
+             py::arg("gamma") = 2.2, py::arg("matrix") = py::none(),
+             py::arg("white_balance") = py::none(),
+             py::arg("panel_size") = py::none(),
+             py::arg("panel_gains") = std::vector<std::array<double, 3>>{},
+             R"pbdoc(
+Set the color calibration used when converting the framebuffer
+
+``gamma`` is the exponent of the transfer curve, either a single number or one
+for each of red, green and blue. It must be positive, and all gains finite;
+``ValueError`` is raised otherwise.
+
+``matrix`` is an optional 3x3 color matrix (a list of rows) applied to the
+linear red, green and blue values, for instance to correct the primaries of a
+batch of panels.
+
+``white_balance`` is an optional gain for each of red, green and blue, applied
+after the matrix.
+
+``panel_gains`` optionally gives a red, green and blue gain for each
+``panel_size = (width, height)`` tile of the framebuffer, in row-major order,
+to even out panels from different batches. Tiles past the end of the list are
+not adjusted.
+
+All of these are folded into the lookup tables used for conversion, so they
+cost nothing per pixel beyond the table lookups (nine instead of three when the
+matrix mixes channels). The new tables are used starting with the next call to
+``show()``.
+)pbdoc");
+
+    py::class_<PyFrameRingProducer>(m, "FrameRingProducer", R"pbdoc(
+Write frames into a ring served by ``PioMatter.serve_frame_ring()``
+
+This is meant for a process other than the one driving the display, and needs
+no access to the hardware. ``name`` is the name passed to
+``serve_frame_ring()``.
+)pbdoc")
+        .def(py::init<const std::string &>(), py::arg("name") = "/piomatter")
+        .def("next_frame", &PyFrameRingProducer::next_frame,
+             py::arg("timeout") = py::none(), R"pbdoc(
+Get the slot for the next frame, to draw into
+
+Returns an array with the shape and colorspace of the display's framebuffer,
+which refers to the shared memory itself, so that drawing into it needs no
+copies. Waits, for at most ``timeout`` seconds if given, until the display is
+done with that slot, and returns None if it isn't by then. Call ``publish()``
+once the frame is complete, and don't touch the array after that.
+)pbdoc")
+        .def("publish", &PyFrameRingProducer::publish, R"pbdoc(
+Make the frame drawn into the slot from ``next_frame()`` the newest frame
+)pbdoc");
+
+    m.def("render_stream_file", &render_stream_file, py::arg("path"),
+          py::arg("colorspace"), py::arg("pinout"), py::arg("geometry"),
+          py::arg("frames"), py::arg("durations"), R"pbdoc(
+Render an animation to a file for ``PioMatter.play_file()``
+
+This converts and renders ``frames`` as ``PioMatter.play()`` would, but without
+any hardware, so it can be done ahead of time or on another machine with the
+same byte order. ``colorspace``, ``pinout`` and ``geometry`` are those that
+would be passed to ``PioMatter``, and ``frames`` and ``durations`` are as for
+``play()``. The streams are rendered at full brightness; any brightness set on
+the ``PioMatter`` playing them is applied when the file is loaded. They are
+converted with the default gamma and no color calibration, since there is no
+display to take it from; a calibration set with ``set_calibration()`` does not
+apply to them.
 )pbdoc");
 
     m.def(